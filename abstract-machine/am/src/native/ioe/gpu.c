@@ -1,6 +1,9 @@
 #include <am.h>
 #include <SDL2/SDL.h>
 #include <fenv.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 //#define MODE_800x600
 #ifdef MODE_800x600
@@ -21,13 +24,59 @@
 static SDL_Window *window = NULL;
 static SDL_Surface *surface = NULL;
 
+// headless mode: no window, frames can be dumped on every sync
+bool __am_headless = false;
+static FILE *sum_fp = NULL, *dump_fp = NULL;
+static uint64_t nr_sync = 0;
+
 static Uint32 texture_sync(Uint32 interval, void *param) {
   SDL_BlitScaled(surface, NULL, SDL_GetWindowSurface(window), NULL);
   SDL_UpdateWindowSurface(window);
   return interval;
 }
 
+// FNV-1a, the same as the checksum log of NEMU
+static uint64_t frame_checksum(const void *p, int n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  const uint8_t *b = p;
+  for (int i = 0; i < n; i ++) {
+    h = (h ^ b[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+// written on the calling thread, the frames are not dumped in the background as in NEMU
+static void frame_sync() {
+  uint64_t id = nr_sync ++;
+  if (sum_fp) {
+    fprintf(sum_fp, "%" PRIu64 " %016" PRIx64 "\n", id, frame_checksum(surface->pixels, W * H * sizeof(uint32_t)));
+    fflush(sum_fp);
+  }
+  if (dump_fp) fwrite(surface->pixels, sizeof(uint32_t), W * H, dump_fp);
+}
+
+static FILE *open_output(const char *env) {
+  const char *path = getenv(env);
+  if (path == NULL) return NULL;
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    fprintf(stderr, "Can not open '%s'\n", path);
+    exit(1);
+  }
+  return fp;
+}
+
 void __am_gpu_init() {
+  const char *headless = getenv("headless");
+  __am_headless = headless && atoi(headless);
+  sum_fp = open_output("fbsum");
+  dump_fp = open_output("fbdump");
+  if (__am_headless) {
+    surface = SDL_CreateRGBSurface(SDL_SWSURFACE, W, H, 32,
+        RMASK, GMASK, BMASK, AMASK);
+    return;
+  }
+
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
   window = SDL_CreateWindow("Native Application",
       SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -56,11 +105,13 @@ void __am_gpu_status(AM_GPU_STATUS_T *stat) {
 
 void __am_gpu_fbdraw(AM_GPU_FBDRAW_T *ctl) {
   int x = ctl->x, y = ctl->y, w = ctl->w, h = ctl->h;
-  if (w == 0 || h == 0) return;
-  feclearexcept(-1);
-  SDL_Surface *s = SDL_CreateRGBSurfaceFrom(ctl->pixels, w, h, 32, w * sizeof(uint32_t),
-      RMASK, GMASK, BMASK, AMASK);
-  SDL_Rect rect = { .x = x, .y = y };
-  SDL_BlitSurface(s, NULL, surface, &rect);
-  SDL_FreeSurface(s);
+  if (w != 0 && h != 0) {
+    feclearexcept(-1);
+    SDL_Surface *s = SDL_CreateRGBSurfaceFrom(ctl->pixels, w, h, 32, w * sizeof(uint32_t),
+        RMASK, GMASK, BMASK, AMASK);
+    SDL_Rect rect = { .x = x, .y = y };
+    SDL_BlitSurface(s, NULL, surface, &rect);
+    SDL_FreeSurface(s);
+  }
+  if (ctl->sync) frame_sync();
 }
@@ -40,7 +40,9 @@ static int event_thread(void *args) {
 }
 
 void __am_input_init() {
+  extern bool __am_headless;
   key_queue_lock = SDL_CreateMutex();
+  if (__am_headless) return; // no window to receive events
   SDL_CreateThread(event_thread, "event thread", NULL);
 }
 
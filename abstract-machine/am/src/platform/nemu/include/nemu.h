@@ -32,8 +32,20 @@
 #define VGACTL_ADDR     (DEVICE_BASE + 0x0000100)
 #define AUDIO_ADDR      (DEVICE_BASE + 0x0000200)
 #define DISK_ADDR       (DEVICE_BASE + 0x0000300)
+#define GPU_ADDR        (DEVICE_BASE + 0x0000400)
+#define NIC_ADDR        (DEVICE_BASE + 0x0000500)
 #define FB_ADDR         (MMIO_BASE   + 0x1000000)
 #define AUDIO_SBUF_ADDR (MMIO_BASE   + 0x1200000)
+#define GPU_MEM_ADDR    (MMIO_BASE   + 0x1400000)
+
+// interrupt controllers (riscv only)
+#define CLINT_ADDR      0x02000000
+#define PLIC_ADDR       0x0c000000
+
+// optional devices present in NEMU
+#define FEATURE_ADDR    (VGACTL_ADDR + 8)
+#define FEATURE_GPU     0x1
+#define FEATURE_NIC     0x2
 
 extern char _pmem_start;
 #define PMEM_SIZE (128 * 1024 * 1024)
@@ -41,6 +53,7 @@ extern char _pmem_start;
 #define NEMU_PADDR_SPACE \
   RANGE(&_pmem_start, PMEM_END), \
   RANGE(FB_ADDR, FB_ADDR + 0x200000), \
+  RANGE(GPU_MEM_ADDR, GPU_MEM_ADDR + 0x100000), \
   RANGE(MMIO_BASE, MMIO_BASE + 0x1000) /* serial, rtc, screen, keyboard */
 
 typedef uintptr_t PTE;
@@ -3,18 +3,50 @@
 
 #define SYNC_ADDR (VGACTL_ADDR + 4)
 
+#define GPU_CMD_ADDR   (GPU_ADDR + 0x00)
+#define GPU_DST_ADDR   (GPU_ADDR + 0x04)
+#define GPU_SRC_ADDR   (GPU_ADDR + 0x08)
+#define GPU_SIZE_ADDR  (GPU_ADDR + 0x0c)
+#define GPU_MEMSZ_ADDR (GPU_ADDR + 0x10)
+
+#define GPU_CMD_MEMCPY 1
+#define GPU_CMD_RENDER 2
+
+static int w = 0, h = 0;
+static bool probed = false, has_accel = false;
+
+// probe at the first use instead of in ioe_init(), so that the programs
+// not using the screen also run without the VGA controller
+static void gpu_probe() {
+  if (probed) return;
+  probed = true;
+  uint32_t size = inl(VGACTL_ADDR);
+  w = size >> 16;
+  h = size & 0xffff;
+  has_accel = inl(FEATURE_ADDR) & FEATURE_GPU;
+}
+
 void __am_gpu_init() {
 }
 
 void __am_gpu_config(AM_GPU_CONFIG_T *cfg) {
+  gpu_probe();
   *cfg = (AM_GPU_CONFIG_T) {
-    .present = true, .has_accel = false,
-    .width = 0, .height = 0,
-    .vmemsz = 0
+    .present = true, .has_accel = has_accel,
+    .width = w, .height = h,
+    .vmemsz = (has_accel ? inl(GPU_MEMSZ_ADDR) : 0)
   };
 }
 
 void __am_gpu_fbdraw(AM_GPU_FBDRAW_T *ctl) {
+  gpu_probe();
+  uint32_t *fb = (uint32_t *)(uintptr_t)FB_ADDR;
+  uint32_t *pixels = ctl->pixels;
+  for (int j = 0; j < ctl->h && ctl->y + j < h; j ++) {
+    for (int i = 0; i < ctl->w && ctl->x + i < w; i ++) {
+      fb[(ctl->y + j) * w + ctl->x + i] = pixels[j * ctl->w + i];
+    }
+  }
   if (ctl->sync) {
     outl(SYNC_ADDR, 1);
   }
@@ -23,3 +55,19 @@ void __am_gpu_fbdraw(AM_GPU_FBDRAW_T *ctl) {
 void __am_gpu_status(AM_GPU_STATUS_T *status) {
   status->ready = true;
 }
+
+void __am_gpu_memcpy(AM_GPU_MEMCPY_T *params) {
+  gpu_probe();
+  panic_on(!has_accel, "no 2D accelerator");
+  outl(GPU_DST_ADDR, params->dest);
+  outl(GPU_SRC_ADDR, (uintptr_t)params->src);
+  outl(GPU_SIZE_ADDR, params->size);
+  outl(GPU_CMD_ADDR, GPU_CMD_MEMCPY);
+}
+
+void __am_gpu_render(AM_GPU_RENDER_T *ep) {
+  gpu_probe();
+  panic_on(!has_accel, "no 2D accelerator");
+  outl(GPU_SRC_ADDR, ep->root);
+  outl(GPU_CMD_ADDR, GPU_CMD_RENDER);
+}
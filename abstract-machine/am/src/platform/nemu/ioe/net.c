@@ -0,0 +1,85 @@
+#include <am.h>
+#include <nemu.h>
+
+#define NIC_CTRL_ADDR      (NIC_ADDR + 0x00)
+#define NIC_RING_SIZE_ADDR (NIC_ADDR + 0x04)
+#define NIC_TX_BASE_ADDR   (NIC_ADDR + 0x08)
+#define NIC_TX_TAIL_ADDR   (NIC_ADDR + 0x0c)
+#define NIC_TX_HEAD_ADDR   (NIC_ADDR + 0x10)
+#define NIC_RX_BASE_ADDR   (NIC_ADDR + 0x14)
+#define NIC_RX_TAIL_ADDR   (NIC_ADDR + 0x18)
+
+#define NR_DESC   64
+#define BUF_SIZE  2048
+#define DESC_DONE 0x1
+
+typedef volatile struct {
+  uint32_t addr;
+  uint16_t len;
+  uint16_t flags;
+} NICDesc;
+
+static NICDesc tx_ring[NR_DESC], rx_ring[NR_DESC];
+static uint8_t tx_buf[NR_DESC][BUF_SIZE], rx_buf[NR_DESC][BUF_SIZE];
+static uint32_t tx_tail = 0, rx_next = 0;
+static bool probed = false, present = false;
+
+// probe at the first use instead of in ioe_init(), because the feature
+// word belongs to the VGA controller, which may not exist
+static void net_probe() {
+  if (probed) return;
+  probed = true;
+  present = inl(FEATURE_ADDR) & FEATURE_NIC;
+  if (!present) return;
+  for (int i = 0; i < NR_DESC; i ++) {
+    rx_ring[i] = (NICDesc) { .addr = (uintptr_t)rx_buf[i], .len = BUF_SIZE, .flags = 0 };
+  }
+  outl(NIC_RING_SIZE_ADDR, NR_DESC);
+  outl(NIC_TX_BASE_ADDR, (uintptr_t)tx_ring);
+  outl(NIC_RX_BASE_ADDR, (uintptr_t)rx_ring);
+  outl(NIC_CTRL_ADDR, 1);
+  outl(NIC_RX_TAIL_ADDR, NR_DESC);
+}
+
+void __am_net_config(AM_NET_CONFIG_T *cfg) {
+  net_probe();
+  cfg->present = present;
+}
+
+void __am_net_status(AM_NET_STATUS_T *stat) {
+  net_probe();
+  panic_on(!present, "no network interface");
+  NICDesc *d = &rx_ring[rx_next % NR_DESC];
+  stat->rx_len = (d->flags & DESC_DONE ? d->len : 0);
+  stat->tx_len = tx_tail - inl(NIC_TX_HEAD_ADDR);
+}
+
+void __am_net_tx(AM_NET_TX_T *tx) {
+  net_probe();
+  panic_on(!present, "no network interface");
+  int len = tx->buf.end - tx->buf.start;
+  panic_on(len > BUF_SIZE, "packet is too large");
+  while (tx_tail - inl(NIC_TX_HEAD_ADDR) == NR_DESC) ; // ring is full
+  int i = tx_tail % NR_DESC;
+  uint8_t *src = tx->buf.start;
+  for (int k = 0; k < len; k ++) tx_buf[i][k] = src[k];
+  tx_ring[i] = (NICDesc) { .addr = (uintptr_t)tx_buf[i], .len = len, .flags = 0 };
+  tx_tail ++;
+  outl(NIC_TX_TAIL_ADDR, tx_tail);
+}
+
+void __am_net_rx(AM_NET_RX_T *rx) {
+  net_probe();
+  panic_on(!present, "no network interface");
+  NICDesc *d = &rx_ring[rx_next % NR_DESC];
+  if (!(d->flags & DESC_DONE)) return;
+  int len = rx->buf.end - rx->buf.start;
+  if (d->len < len) len = d->len;
+  uint8_t *dst = rx->buf.start;
+  for (int k = 0; k < len; k ++) dst[k] = rx_buf[rx_next % NR_DESC][k];
+  d->len = BUF_SIZE;
+  d->flags = 0;
+  rx_next ++;
+  // give the buffer back to the device
+  outl(NIC_RX_TAIL_ADDR, rx_next + NR_DESC);
+}
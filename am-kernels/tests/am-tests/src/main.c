@@ -12,6 +12,9 @@ static const char *tests[256] = {
   ['k'] = "readkey test",
   ['v'] = "display test",
   ['a'] = "audio test",
+  ['b'] = "2D accelerator blit benchmark",
+  ['n'] = "network latency and throughput test",
+  ['e'] = "network echo server (peer of 'n')",
   ['p'] = "x86 virtual memory test",
 };
 
@@ -25,6 +28,9 @@ int main(const char *args) {
     CASE('k', keyboard_test, IOE);
     CASE('v', video_test, IOE);
     CASE('a', audio_test, IOE);
+    CASE('b', blit_test, IOE);
+    CASE('n', net_ping, IOE);
+    CASE('e', net_echo, IOE);
     CASE('p', vm_test, CTE(vm_handler), VME(simple_pgalloc, simple_pgfree));
     case 'H':
     default:
@@ -0,0 +1,76 @@
+#include <amtest.h>
+
+#define SW      32
+#define SH      32
+#define ROUNDS  2000
+#define BATCH   64
+
+static uint32_t sprite[SW * SH];
+static struct gpu_canvas nodes[BATCH];
+
+static uint64_t uptime() { return io_read(AM_TIMER_UPTIME).us; }
+
+static void report(const char *name, int n, uint64_t us) {
+  if (us == 0) us = 1;
+  printf("%s: %d blits in %d us, %d blits/s\n", name, n, (int)us, (int)(n * 1000000ull / us));
+}
+
+static void blit_sw(int w, int h) {
+  uint64_t t0 = uptime();
+  for (int i = 0; i < ROUNDS; i ++) {
+    io_write(AM_GPU_FBDRAW, (i * 7) % (w - SW), (i * 13) % (h - SH), sprite, SW, SH, false);
+  }
+  io_write(AM_GPU_FBDRAW, 0, 0, NULL, 0, 0, true);
+  report("software", ROUNDS, uptime() - t0);
+}
+
+static void blit_accel(int w, int h, int batch) {
+  // GPU memory layout: sprite pixels, followed by the canvas nodes
+  gpuptr_t tex = 0, root = sizeof(sprite);
+  io_write(AM_GPU_MEMCPY, tex, sprite, sizeof(sprite));
+
+  uint64_t t0 = uptime();
+  int n = 0;
+  for (int i = 0; i < ROUNDS; i += batch) {
+    // the last batch may be partial
+    int nr = (ROUNDS - i < batch ? ROUNDS - i : batch);
+    for (int k = 0; k < nr; k ++) {
+      int j = i + k;
+      nodes[k] = (struct gpu_canvas) {
+        .type = AM_GPU_TEXTURE, .w = 0, .h = 0,
+        .x1 = (j * 7) % (w - SW), .y1 = (j * 13) % (h - SH), .w1 = SW, .h1 = SH,
+        .sibling = (k == nr - 1 ? AM_GPU_NULL : root + (k + 1) * sizeof(nodes[0])),
+        .texture = { .w = SW, .h = SH, .pixels = tex },
+      };
+    }
+    io_write(AM_GPU_MEMCPY, root, nodes, nr * sizeof(nodes[0]));
+    io_write(AM_GPU_RENDER, root);
+    n += nr;
+  }
+  io_write(AM_GPU_FBDRAW, 0, 0, NULL, 0, 0, true);
+  report(batch == 1 ? "accel" : "accel (batched)", n, uptime() - t0);
+}
+
+void blit_test() {
+  AM_GPU_CONFIG_T cfg = io_read(AM_GPU_CONFIG);
+  int w = cfg.width, h = cfg.height;
+  if (w <= SW || h <= SH) {
+    printf("screen is too small (%d x %d)\n", w, h);
+    return;
+  }
+
+  for (int y = 0; y < SH; y ++) {
+    for (int x = 0; x < SW; x ++) {
+      sprite[y * SW + x] = ((x * 8) << 16) | ((y * 8) << 8) | 0x80;
+    }
+  }
+
+  blit_sw(w, h);
+  if (!cfg.has_accel) {
+    printf("no 2D accelerator\n");
+    return;
+  }
+  assert(cfg.vmemsz >= sizeof(sprite) + sizeof(nodes));
+  blit_accel(w, h, 1);
+  blit_accel(w, h, BATCH);
+}
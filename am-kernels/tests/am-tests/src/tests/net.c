@@ -0,0 +1,84 @@
+#include <amtest.h>
+
+// Run 'e' in one NEMU and 'n' in another one connected to it, or run
+// 'n' alone with a loopback NIC.
+
+#define NR_PING  1000
+#define NR_BURST 10000
+#define PKT_SIZE 64
+#define TIMEOUT  (10 * 1000000) // us
+
+typedef struct {
+  uint32_t magic, seq;
+  uint64_t t;
+  uint8_t payload[PKT_SIZE - 16];
+} Packet;
+
+#define MAGIC_PING 0x676e6970
+
+static uint64_t uptime() { return io_read(AM_TIMER_UPTIME).us; }
+
+static void send(Packet *p) {
+  io_write(AM_NET_TX, RANGE(p, p + 1));
+}
+
+static bool recv(Packet *p) {
+  if (io_read(AM_NET_STATUS).rx_len == 0) return false;
+  io_write(AM_NET_RX, RANGE(p, p + 1));
+  return p->magic == MAGIC_PING;
+}
+
+static void check_present() {
+  if (!io_read(AM_NET_CONFIG).present) {
+    printf("no network interface\n");
+    halt(1);
+  }
+}
+
+void net_echo() {
+  check_present();
+  printf("echo server started\n");
+  Packet p;
+  while (1) {
+    if (recv(&p)) send(&p);
+  }
+}
+
+void net_ping() {
+  check_present();
+  Packet p = { .magic = MAGIC_PING };
+
+  // latency: one packet in flight
+  uint64_t total = 0, max = 0;
+  for (int i = 0; i < NR_PING; i ++) {
+    p.seq = i;
+    p.t = uptime();
+    send(&p);
+    while (!recv(&p) || p.seq != i) ;
+    uint64_t rtt = uptime() - p.t;
+    total += rtt;
+    if (rtt > max) max = rtt;
+  }
+  printf("latency: avg %d us, max %d us over %d pings\n",
+      (int)(total / NR_PING), (int)max, NR_PING);
+
+  // throughput: keep the TX ring busy
+  int sent = 0, received = 0;
+  uint64_t t0 = uptime();
+  while (received < NR_BURST) {
+    if (uptime() - t0 > TIMEOUT) {
+      printf("timeout: %d packets lost\n", sent - received);
+      break;
+    }
+    if (sent < NR_BURST && io_read(AM_NET_STATUS).tx_len < 32) {
+      p.seq = sent ++;
+      send(&p);
+    }
+    Packet r;
+    if (recv(&r)) received ++;
+  }
+  uint64_t us = uptime() - t0;
+  if (us == 0) us = 1;
+  printf("throughput: %d packets in %d us, %d packets/s\n",
+      received, (int)us, (int)(received * 1000000ull / us));
+}
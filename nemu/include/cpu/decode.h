@@ -23,7 +23,6 @@ typedef struct Decode {
   vaddr_t snpc; // static next pc
   vaddr_t dnpc; // dynamic next pc
   ISADecodeInfo isa;
-  IFDEF(CONFIG_ITRACE, char logbuf[128]);
 } Decode;
 
 // --- pattern matching mechanism ---
@@ -86,12 +85,34 @@ finish:
 }
 
 
+// --- instruction statistics ---
+#ifdef CONFIG_ISTAT
+typedef struct {
+  const char *name;
+  uint64_t count;
+  uint64_t taken; // dnpc != snpc
+} InstStat;
+
+// one counter for every pattern, the linker collects the pointers to them
+// into a section
+#define INSTPAT_STAT(s, inst, ...) do { \
+  static InstStat __istat = { .name = #inst }; \
+  static InstStat *__istat_p __attribute__((section("nemu_istat"), used)) = &__istat; \
+  __istat.count ++; \
+  __istat.taken += ((s)->dnpc != (s)->snpc); \
+} while (0)
+#else
+#define INSTPAT_STAT(s, ...)
+#endif
+
 // --- pattern matching wrappers for decode ---
 #define INSTPAT(pattern, ...) do { \
   uint64_t key, mask, shift; \
   pattern_decode(pattern, STRLEN(pattern), &key, &mask, &shift); \
   if ((((uint64_t)INSTPAT_INST(s) >> shift) & mask) == key) { \
+    PHASE(PHASE_EXEC); \
     INSTPAT_MATCH(s, ##__VA_ARGS__); \
+    INSTPAT_STAT(s, ##__VA_ARGS__); \
     goto *(__instpat_end); \
   } \
 } while (0)
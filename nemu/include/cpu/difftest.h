@@ -24,17 +24,34 @@ void difftest_skip_ref();
 void difftest_skip_dut(int nr_ref, int nr_dut);
 void difftest_set_patch(void (*fn)(void *arg), void *arg);
 void difftest_step(vaddr_t pc, vaddr_t npc);
+bool difftest_sync();
+bool difftest_block_end(bool force);
+void difftest_intr(word_t NO);
+void difftest_log_write(paddr_t addr, int len, word_t data);
+void difftest_resync(paddr_t addr, size_t n);
 void difftest_detach();
 void difftest_attach();
+// instructions executed by DUT but not checked yet
+uint64_t difftest_lag();
 #else
 static inline void difftest_skip_ref() {}
 static inline void difftest_skip_dut(int nr_ref, int nr_dut) {}
 static inline void difftest_set_patch(void (*fn)(void *arg), void *arg) {}
 static inline void difftest_step(vaddr_t pc, vaddr_t npc) {}
+static inline bool difftest_sync() { return true; }
+static inline bool difftest_block_end(bool force) { return true; }
+static inline void difftest_intr(word_t NO) {}
+static inline void difftest_log_write(paddr_t addr, int len, word_t data) {}
+static inline void difftest_resync(paddr_t addr, size_t n) {}
 static inline void difftest_detach() {}
 static inline void difftest_attach() {}
+static inline uint64_t difftest_lag() { return 0; }
 #endif
 
+// hooks of NEMU as REF, see difftest_exec_commit()
+void difftest_ref_log_write(paddr_t addr, int len, word_t data);
+void difftest_ref_commit(vaddr_t pc);
+
 extern void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction);
 extern void (*ref_difftest_regcpy)(void *dut, bool direction);
 extern void (*ref_difftest_exec)(uint64_t n);
@@ -0,0 +1,168 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CTRACE_DEF_H__
+#define __CTRACE_DEF_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Commit trace, one record per instruction with what it writes.
+//
+// file   := CTraceHeader chunk* index CTraceFooter
+// chunk  := CTraceChunk, followed by `comp_size` bytes of zlib data
+// index  := CTraceIndex[nr_chunk]
+//
+// Every chunk holds `chunk_insts` records, except the last one. Records
+// are delta-encoded against the previous ones in the same chunk, so the
+// chunks can be decoded independently.
+
+#define CTRACE_MAGIC   "NEMUCTR1"
+#define CTRACE_VERSION 1
+#define CTRACE_NR_REG  64
+#define CTRACE_MAX_WRITE 4
+// upper bound of an encoded record
+#define CTRACE_MAX_RECORD (1 + 10 + 4 + 1 + 10 + 1 + CTRACE_MAX_WRITE * (1 + 10 + 10))
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t chunk_insts;
+} CTraceHeader;
+
+typedef struct {
+  uint64_t first_idx;
+  uint32_t nr_inst;
+  uint32_t raw_size;
+  uint32_t comp_size;
+  uint32_t pad;
+} CTraceChunk;
+
+typedef struct {
+  uint64_t offset; // of CTraceChunk
+  uint64_t first_idx;
+} CTraceIndex;
+
+typedef struct {
+  uint64_t index_offset;
+  uint64_t nr_chunk;
+  uint64_t nr_inst;
+  char magic[8];
+} CTraceFooter;
+
+typedef struct {
+  uint64_t pc;
+  uint64_t data;
+  uint32_t inst;
+  uint8_t rd; // 0 if no register is written
+  uint8_t nr_write;
+  struct {
+    uint64_t addr;
+    uint64_t data;
+    uint8_t len;
+  } write[CTRACE_MAX_WRITE];
+} CTraceRecord;
+
+// the context of delta encoding, reset at the beginning of every chunk
+typedef struct {
+  uint64_t pc;
+  uint64_t reg[CTRACE_NR_REG];
+  uint64_t waddr;
+} CTraceState;
+
+enum {
+  CTRACE_PC_JUMP = 0x1, // otherwise pc = last pc + 4
+  CTRACE_RD      = 0x2,
+  CTRACE_WRITE   = 0x4,
+};
+
+static inline uint64_t ctrace_zigzag(int64_t x) { return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63); }
+static inline int64_t ctrace_unzigzag(uint64_t x) { return (int64_t)(x >> 1) ^ -(int64_t)(x & 1); }
+
+static inline uint8_t *ctrace_put_varint(uint8_t *p, uint64_t x) {
+  while (x >= 0x80) { *p ++ = (x & 0x7f) | 0x80; x >>= 7; }
+  *p ++ = x;
+  return p;
+}
+
+static inline const uint8_t *ctrace_get_varint(const uint8_t *p, uint64_t *x) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (*p & 0x80) { v |= (uint64_t)(*p ++ & 0x7f) << shift; shift += 7; }
+  *x = v | ((uint64_t)*p ++ << shift);
+  return p;
+}
+
+static inline uint8_t *ctrace_encode(uint8_t *p, CTraceState *s, const CTraceRecord *r) {
+  uint8_t *flags = p ++;
+  *flags = 0;
+  if (r->pc != s->pc + 4) {
+    *flags |= CTRACE_PC_JUMP;
+    p = ctrace_put_varint(p, ctrace_zigzag(r->pc - s->pc - 4));
+  }
+  s->pc = r->pc;
+  memcpy(p, &r->inst, 4);
+  p += 4;
+  if (r->rd != 0) {
+    *flags |= CTRACE_RD;
+    *p ++ = r->rd;
+    p = ctrace_put_varint(p, ctrace_zigzag(r->data - s->reg[r->rd]));
+    s->reg[r->rd] = r->data;
+  }
+  if (r->nr_write != 0) {
+    *flags |= CTRACE_WRITE;
+    *p ++ = r->nr_write;
+    for (int i = 0; i < r->nr_write; i ++) {
+      *p ++ = r->write[i].len;
+      p = ctrace_put_varint(p, ctrace_zigzag(r->write[i].addr - s->waddr));
+      p = ctrace_put_varint(p, r->write[i].data);
+      s->waddr = r->write[i].addr;
+    }
+  }
+  return p;
+}
+
+static inline const uint8_t *ctrace_decode(const uint8_t *p, CTraceState *s, CTraceRecord *r) {
+  uint64_t x;
+  uint8_t flags = *p ++;
+  r->pc = s->pc + 4;
+  if (flags & CTRACE_PC_JUMP) { p = ctrace_get_varint(p, &x); r->pc += ctrace_unzigzag(x); }
+  s->pc = r->pc;
+  memcpy(&r->inst, p, 4);
+  p += 4;
+  r->rd = 0;
+  r->data = 0;
+  if (flags & CTRACE_RD) {
+    r->rd = *p ++ % CTRACE_NR_REG;
+    p = ctrace_get_varint(p, &x);
+    r->data = s->reg[r->rd] + ctrace_unzigzag(x);
+    s->reg[r->rd] = r->data;
+  }
+  r->nr_write = 0;
+  if (flags & CTRACE_WRITE) {
+    r->nr_write = *p ++;
+    if (r->nr_write > CTRACE_MAX_WRITE) r->nr_write = CTRACE_MAX_WRITE; // corrupted
+    for (int i = 0; i < r->nr_write; i ++) {
+      r->write[i].len = *p ++;
+      p = ctrace_get_varint(p, &x);
+      r->write[i].addr = s->waddr + ctrace_unzigzag(x);
+      p = ctrace_get_varint(p, &r->write[i].data);
+      s->waddr = r->write[i].addr;
+    }
+  }
+  return p;
+}
+
+#endif
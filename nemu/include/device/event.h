@@ -0,0 +1,40 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include <common.h>
+
+#define TIMER_HZ 60
+
+typedef void (*event_handler_t)();
+
+/* Events are keyed by the deadline in guest time (unit: us, see `get_guest_time()`).
+ * A periodic event is armed when it is added, and re-armed after it fires.
+ */
+int add_event(const char *name, uint64_t period, event_handler_t handler);
+void event_schedule(int id, uint64_t when);
+void event_cancel(int id);
+
+// the CPU calls `event_update()` once `g_nr_guest_inst` reaches this value
+extern uint64_t g_event_next;
+void event_update();
+
+// name and the number of times fired of the event `id`, false if there is no such event
+bool event_stat(int id, const char **name, uint64_t *count);
+
+#endif
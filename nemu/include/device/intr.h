@@ -13,12 +13,16 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
-#ifndef __DEVICE_ALARM_H__
-#define __DEVICE_ALARM_H__
+#ifndef __DEVICE_INTR_H__
+#define __DEVICE_INTR_H__
 
-#define TIMER_HZ 60
+// interrupt sources of the PLIC
+enum {
+  IRQ_TIMER = 1,
+  IRQ_NIC,
+  NR_IRQ = 32
+};
 
-typedef void (*alarm_handler_t) ();
-void add_alarm_handle(alarm_handler_t h);
+void dev_raise_intr(int irq);
 
 #endif
@@ -50,6 +50,10 @@ void add_pio_map(const char *name, ioaddr_t addr,
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 
+IOMap* fetch_mmio_maps(int *n);
+int io_space_memfd();
+uint32_t io_space_offset(void *space);
+
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
 
@@ -37,4 +37,18 @@ enum { DIFFTEST_TO_DUT, DIFFTEST_TO_REF };
 # error Unsupport ISA
 #endif
 
+// the GPR and memory written by an instruction, see difftest_exec_commit() of REF
+typedef struct {
+  uint64_t pc;
+  uint64_t data;
+  uint64_t waddr; // valid if wlen != 0
+  uint64_t wdata; // the low wlen bytes
+  uint32_t rd;    // 0 if no GPR is written
+  uint32_t wlen;
+} diff_commit_t;
+
+// the unit of difftest_memhash() of REF, a REF which provides it should
+// also support difftest_memcpy() to DUT
+#define DIFFTEST_HASH_PAGE 4096
+
 #endif
@@ -0,0 +1,62 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __FTRACE_DEF_H__
+#define __FTRACE_DEF_H__
+
+#include <stdint.h>
+
+// Function call trace, one record per call or return.
+//
+// file   := FTraceHeader FTraceRecord[nr_record] FTraceFunc[nr_func] names FTraceFooter
+//
+// The functions are appended at exit, sorted by address, with their
+// profile and the symbol names from the ELF given by --elf.
+
+#define FTRACE_MAGIC   "NEMUFTR1"
+#define FTRACE_VERSION 1
+#define FTRACE_RET     (1ull << 63) // in FTraceRecord.time
+#define FTRACE_NO_NAME UINT32_MAX
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t word_size;
+} FTraceHeader;
+
+typedef struct {
+  uint64_t time;    // instructions executed before the call or return, | FTRACE_RET for returns
+  uint64_t pc;      // of the call or return
+  uint64_t target;
+} FTraceRecord;
+
+typedef struct {
+  uint64_t addr;
+  uint64_t nr_call;
+  uint64_t inclusive; // instructions, including the callees
+  uint64_t exclusive; // instructions, excluding the callees
+  uint32_t name;      // offset in the names, or FTRACE_NO_NAME
+  uint32_t pad;
+} FTraceFunc;
+
+typedef struct {
+  uint64_t nr_record;
+  uint64_t func_offset;
+  uint64_t nr_func;
+  uint64_t name_size; // the names follow the functions
+  char magic[8];
+} FTraceFooter;
+
+#endif
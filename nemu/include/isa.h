@@ -36,6 +36,11 @@ word_t isa_reg_str2val(const char *name, bool *success);
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+// GPR written by `inst`, 0 if none
+int isa_inst_rd(uint32_t inst);
+// class of the instruction named `name` in INSTPAT, for the statistics
+enum { INST_OTHER, INST_LOAD, INST_STORE, INST_BRANCH, INST_JUMP, NR_INST_CLASS };
+int isa_inst_class(const char *name);
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
@@ -50,9 +55,16 @@ paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type);
 vaddr_t isa_raise_intr(word_t NO, vaddr_t epc);
 #define INTR_EMPTY ((word_t)-1)
 word_t isa_query_intr();
+#ifndef isa_intr_pending
+// cheap check before calling `isa_query_intr()`, an ISA which has
+// interrupt sources should define it, otherwise none is taken
+#define isa_intr_pending() false
+#endif
 
 // difftest
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
 void isa_difftest_attach();
+// GPR written by the instruction at `pc` just executed, 0 if none
+int isa_difftest_commit(vaddr_t pc, word_t *data);
 
 #endif
@@ -0,0 +1,90 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_HASH_H__
+#define __MEMORY_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A fast non-cryptographic hash of memory, in the way of XXH3. Each 64-byte
+// stripe updates 8 independent lanes with 32x32->64 multiplications, with
+// SSE2 if available. It is used to compare memory between DUT and REF, so
+// it only needs to be the same on both sides.
+
+#define MEM_HASH_PRIME1 0x9e3779b185ebca87ull
+#define MEM_HASH_PRIME2 0xc2b2ae3d27d4eb4full
+#define MEM_HASH_PRIME3 0x165667b19e3779f9ull
+
+static inline uint64_t mem_hash_avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= MEM_HASH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+static inline uint64_t mem_hash(const void *buf, size_t len) {
+  static const uint64_t key[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+  };
+  uint64_t acc[8] = {
+    MEM_HASH_PRIME1, MEM_HASH_PRIME2, MEM_HASH_PRIME3, MEM_HASH_PRIME1 ^ MEM_HASH_PRIME2,
+    MEM_HASH_PRIME2 ^ MEM_HASH_PRIME3, MEM_HASH_PRIME3 ^ MEM_HASH_PRIME1, ~MEM_HASH_PRIME1, ~MEM_HASH_PRIME2,
+  };
+  const uint8_t *p = (const uint8_t *)buf;
+  size_t nr_stripe = len / 64;
+#ifdef __SSE2__
+  __m128i a[4], k[4];
+  for (int j = 0; j < 4; j ++) {
+    a[j] = _mm_loadu_si128((const __m128i *)&acc[2 * j]);
+    k[j] = _mm_loadu_si128((const __m128i *)&key[2 * j]);
+  }
+  for (size_t s = 0; s < nr_stripe; s ++, p += 64) {
+    for (int j = 0; j < 4; j ++) {
+      __m128i d = _mm_loadu_si128((const __m128i *)(p + 16 * j));
+      __m128i x = _mm_xor_si128(d, k[j]);
+      __m128i prod = _mm_mul_epu32(x, _mm_srli_epi64(x, 32));
+      __m128i swap = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+      a[j] = _mm_add_epi64(a[j], _mm_add_epi64(prod, swap));
+    }
+  }
+  for (int j = 0; j < 4; j ++) _mm_storeu_si128((__m128i *)&acc[2 * j], a[j]);
+#else
+  for (size_t s = 0; s < nr_stripe; s ++, p += 64) {
+    for (int i = 0; i < 8; i ++) {
+      uint64_t d;
+      memcpy(&d, p + 8 * i, 8);
+      uint64_t k = d ^ key[i];
+      acc[i ^ 1] += d;
+      acc[i] += (k & 0xffffffffu) * (k >> 32);
+    }
+  }
+#endif
+
+  uint64_t h = len * MEM_HASH_PRIME1;
+  for (size_t i = 0; i < len % 64; i ++) h = (h ^ p[i]) * MEM_HASH_PRIME2;
+  for (int i = 0; i < 8; i ++) {
+    h ^= mem_hash_avalanche(acc[i] ^ key[i]);
+    h = h * MEM_HASH_PRIME1 + MEM_HASH_PRIME3;
+  }
+  return mem_hash_avalanche(h);
+}
+
+#endif
@@ -31,6 +31,9 @@ static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+/* the file descriptor backing pmem, only valid with CONFIG_PMEM_MEMFD */
+int pmem_memfd();
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
@@ -21,6 +21,9 @@
 word_t vaddr_ifetch(vaddr_t addr, int len);
 word_t vaddr_read(vaddr_t addr, int len);
 void vaddr_write(vaddr_t addr, int len, word_t data);
+void vaddr_watch_reset();
+void vaddr_watch(vaddr_t addr, int len);
+void vaddr_dma_write(vaddr_t addr, int len);
 
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
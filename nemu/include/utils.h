@@ -33,6 +33,86 @@ extern NEMUState nemu_state;
 // ----------- timer -----------
 
 uint64_t get_time();
+uint64_t get_guest_time();
+
+// ----------- itrace -----------
+
+void trace_inst(vaddr_t pc, uint32_t inst, word_t wb);
+void itrace_dump();
+void itrace_log(vaddr_t pc, uint32_t inst);
+void itrace_print(vaddr_t pc, uint32_t inst);
+void itrace_flush();
+void display_inst();
+void itrace_checkpoint();
+void itrace_rollback();
+
+// ----------- ctrace -----------
+
+void ctrace_commit(vaddr_t pc, uint32_t inst);
+void ctrace_log_write(paddr_t addr, int len, word_t data);
+void ctrace_close();
+void ctrace_checkpoint();
+void ctrace_rollback();
+
+// ----------- istat -----------
+
+void istat_display();
+
+// ----------- prof -----------
+
+enum {
+  PHASE_MONITOR, // outside the emulation loop, not sampled
+  PHASE_FETCH, PHASE_DECODE, PHASE_EXEC, PHASE_TRACE, PHASE_WATCH,
+  PHASE_LOOP, PHASE_INTR, PHASE_EVENT, PHASE_IO, NR_PHASE
+};
+
+#ifdef CONFIG_PROF
+extern volatile int g_phase;
+extern const char * volatile g_phase_name; // of the event or device in PHASE_EVENT and PHASE_IO
+#define PHASE(p) (g_phase = (p))
+#else
+#define PHASE(p)
+#endif
+void prof_display();
+
+// ----------- metrics -----------
+
+extern uint64_t g_metrics_next;
+void metrics_publish();
+
+// ----------- rr -----------
+
+extern uint64_t g_rr_next;
+bool rr_snapshot();
+bool rr_replaying();
+bool rr_input_replayed();
+void rr_input(void *buf, size_t len);
+
+// ----------- host inputs -----------
+
+bool replay_active();
+void replay_input(void *buf, size_t len);
+void replay_close();
+
+// Values from the host which the guest can observe go through here, to be
+// logged, or replaced by the logged ones.
+static inline void host_input(void *buf, size_t len) {
+  IFDEF(CONFIG_REPLAY, replay_input(buf, len));
+  IFDEF(CONFIG_RR, rr_input(buf, len));
+}
+
+// whether host_input() replaces the values, then the host need not be asked
+static inline bool host_input_replayed() {
+  return MUXDEF(CONFIG_REPLAY, replay_active(), false) || MUXDEF(CONFIG_RR, rr_input_replayed(), false);
+}
+
+// ----------- ftrace -----------
+
+void ftrace_call(vaddr_t pc, vaddr_t target);
+void ftrace_ret(vaddr_t pc, vaddr_t target);
+void ftrace_close();
+void ftrace_checkpoint();
+void ftrace_rollback();
 
 // ----------- log -----------
 
@@ -67,8 +147,10 @@ uint64_t get_time();
   } while (0) \
 )
 
+// the instruction trace is written to the log lazily, keep the order
 #define _Log(...) \
   do { \
+    IFDEF(CONFIG_ITRACE, itrace_flush()); \
     printf(__VA_ARGS__); \
     log_write(__VA_ARGS__); \
   } while (0)
@@ -24,7 +24,7 @@ $(BINARY): compile_git
 
 # Some convenient rules
 
-override ARGS ?= --log=$(BUILD_DIR)/nemu-log.txt
+override ARGS ?= --log=$(BUILD_DIR)/nemu-log.txt --itrace=$(BUILD_DIR)/nemu-itrace.bin
 override ARGS += $(ARGS_DIFF)
 
 # Command to execute NEMU
@@ -16,6 +16,8 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <device/event.h>
+#include <memory/vaddr.h>
 #include <locale.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -30,16 +32,21 @@ uint64_t g_nr_guest_inst = 0;
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 
-void device_update();
-extern void check_wp();
+extern void check_wp(vaddr_t pc);
+extern bool bp_page(vaddr_t pc);
+extern bool check_bp(vaddr_t pc);
 
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
 #ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
+  if (ITRACE_COND) { itrace_log(_this->pc, _this->isa.inst.val); }
 #endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
+  if (g_print_step) { IFDEF(CONFIG_ITRACE, itrace_print(_this->pc, _this->isa.inst.val)); }
+  // before difftest, which may roll back this instruction
+  IFDEF(CONFIG_CTRACE, ctrace_commit(_this->pc, _this->isa.inst.val));
   IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
-  IFDEF(CONFIG_WATCHPOINT, check_wp())
+  IFDEF(CONFIG_TARGET_SHARE, difftest_ref_commit(_this->pc));
+  PHASE(PHASE_WATCH);
+  IFDEF(CONFIG_WATCHPOINT, check_wp(_this->pc));
 }
 
 static void exec_once(Decode *s, vaddr_t pc) {
@@ -47,44 +54,83 @@ static void exec_once(Decode *s, vaddr_t pc) {
   s->snpc = pc;
   isa_exec_once(s);
   cpu.pc = s->dnpc;
-#ifdef CONFIG_ITRACE
-  char *p = s->logbuf;
-  p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
-  int ilen = s->snpc - s->pc;
-  int i;
-  uint8_t *inst = (uint8_t *)&s->isa.inst.val;
-  for (i = ilen - 1; i >= 0; i --) {
-    p += snprintf(p, 4, " %02x", inst[i]);
+}
+
+static void take_intr() {
+  word_t intr = isa_query_intr();
+  if (intr != INTR_EMPTY) {
+    cpu.pc = isa_raise_intr(intr, cpu.pc);
+    IFDEF(CONFIG_DIFFTEST, difftest_intr(intr));
   }
-  int ilen_max = MUXDEF(CONFIG_ISA_x86, 8, 4);
-  int space_len = ilen_max - ilen;
-  if (space_len < 0) space_len = 0;
-  space_len = space_len * 3 + 1;
-  memset(p, ' ', space_len);
-  p += space_len;
-
-#ifndef CONFIG_ISA_loongarch32r
-  void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
-  disassemble(p, s->logbuf + sizeof(s->logbuf) - p,
-      MUXDEF(CONFIG_ISA_x86, s->snpc, s->pc), (uint8_t *)&s->isa.inst.val, ilen);
-#else
-  p[0] = '\0'; // the upstream llvm does not support loongarch32r
-#endif
-#endif
 }
 
+static inline bool event_due() {
+  return MUXDEF(CONFIG_DEVICE, g_nr_guest_inst >= g_event_next, false);
+}
 
-static void execute(uint64_t n) {
+// Run until `g_nr_guest_inst` reaches `end`. A rollback by difftest
+// decreases `g_nr_guest_inst`, so the instructions rolled back are run
+// again within the same budget.
+static void exec_loop(uint64_t end) {
   Decode s;
-  for (;n > 0; n --) {
+  // whether the current code page has breakpoints, updated at block entries
+  // and page crossings; the instruction to resume from is never stopped at
+  IFDEF(CONFIG_BREAKPOINT, bool bp_armed = bp_page(cpu.pc); uint64_t start = g_nr_guest_inst);
+  // take snapshots for reverse execution, the restored process returns to sdb at once
+  IFDEF(CONFIG_RR, if (g_nr_guest_inst >= g_rr_next && rr_snapshot()) end = 0);
+  while (g_nr_guest_inst < end && nemu_state.state == NEMU_RUNNING) {
+#ifdef CONFIG_BREAKPOINT
+    if (unlikely(bp_armed) && g_nr_guest_inst != start && check_bp(cpu.pc)) break;
+#endif
     exec_once(&s, cpu.pc);
     g_nr_guest_inst ++;
     trace_and_difftest(&s, cpu.pc);
+    PHASE(PHASE_LOOP);
     if (nemu_state.state != NEMU_RUNNING) break;
-    IFDEF(CONFIG_DEVICE, device_update());
+#ifdef CONFIG_BREAKPOINT
+    // a rollback by difftest also moves the pc
+    if (s.dnpc != s.snpc || ((s.pc ^ s.dnpc) & ~(vaddr_t)PAGE_MASK) || cpu.pc != s.dnpc) bp_armed = bp_page(cpu.pc);
+#endif
+    if (s.dnpc != s.snpc) {
+      // end of a basic block
+      IFDEF(CONFIG_METRICS, if (unlikely(g_nr_guest_inst >= g_metrics_next)) metrics_publish());
+#ifdef CONFIG_DIFFTEST
+      // the REF should catch up before devices and interrupts change the state
+      if (!difftest_block_end(event_due() || isa_intr_pending())) {
+        IFDEF(CONFIG_BREAKPOINT, bp_armed = bp_page(cpu.pc));
+        continue;
+      }
+#endif
+      PHASE(PHASE_EVENT);
+      IFDEF(CONFIG_DEVICE, if (event_due()) event_update());
+      if (unlikely(isa_intr_pending())) {
+        PHASE(PHASE_INTR);
+        take_intr();
+        IFDEF(CONFIG_BREAKPOINT, bp_armed = bp_page(cpu.pc));
+      }
+#ifdef CONFIG_RR
+      if (unlikely(g_nr_guest_inst >= g_rr_next) && rr_snapshot()) break;
+#endif
+    }
   }
 }
 
+static void execute(uint64_t n) {
+  uint64_t end = (n > UINT64_MAX - g_nr_guest_inst ? UINT64_MAX : g_nr_guest_inst + n);
+  exec_loop(end);
+  PHASE(PHASE_TRACE);
+#ifdef CONFIG_DIFFTEST
+  // a stop within the instructions rolled back by a mismatch is undone,
+  // replay them to find the mismatch
+  while (nemu_state.state != NEMU_ABORT && !difftest_sync() && nemu_state.state == NEMU_RUNNING) {
+    exec_loop(end);
+  }
+#endif
+  IFDEF(CONFIG_ITRACE, itrace_flush());
+  IFDEF(CONFIG_METRICS, metrics_publish());
+  PHASE(PHASE_MONITOR);
+}
+
 static void statistic() {
   IFNDEF(CONFIG_TARGET_AM, setlocale(LC_NUMERIC, ""));
 #define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%", "%'") PRIu64
@@ -92,17 +138,23 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_ISTAT, istat_display());
+  IFDEF(CONFIG_PROF, prof_display());
 }
 
-extern void display_inst();
 void assert_fail_msg() {
+  IFDEF(CONFIG_ITRACE, display_inst());
+  IFDEF(CONFIG_ITRACE, itrace_dump());
   isa_reg_display();
   statistic();
+  IFDEF(CONFIG_CTRACE, ctrace_close());
+  IFDEF(CONFIG_FTRACE, ftrace_close());
+  IFDEF(CONFIG_REPLAY, replay_close());
 }
 
 /* Simulate how the CPU works. */
 void cpu_exec(uint64_t n) {
-  g_print_step = (n < MAX_INST_TO_PRINT);
+  g_print_step = (n < MAX_INST_TO_PRINT) && !MUXDEF(CONFIG_RR, rr_replaying(), false);
   switch (nemu_state.state) {
     case NEMU_END: case NEMU_ABORT:
       printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
@@ -121,7 +173,8 @@ void cpu_exec(uint64_t n) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
 
     case NEMU_END: case NEMU_ABORT:
-      display_inst();
+      IFDEF(CONFIG_ITRACE, display_inst());
+      if (nemu_state.state == NEMU_ABORT || nemu_state.halt_ret != 0) IFDEF(CONFIG_ITRACE, itrace_dump());
       Log("nemu: %s at pc = " FMT_WORD,
           (nemu_state.state == NEMU_ABORT ? ANSI_FMT("ABORT", ANSI_FG_RED) :
            (nemu_state.halt_ret == 0 ? ANSI_FMT("HIT GOOD TRAP", ANSI_FG_GREEN) :
@@ -18,6 +18,7 @@
 #include <isa.h>
 #include <cpu/cpu.h>
 #include <memory/paddr.h>
+#include <memory/host.h>
 #include <utils.h>
 #include <difftest-def.h>
 
@@ -28,12 +29,499 @@ void (*ref_difftest_raise_intr)(uint64_t NO) = NULL;
 
 #ifdef CONFIG_DIFFTEST
 
+extern uint64_t g_nr_guest_inst;
+
 static bool is_skip_ref = false;
 static int skip_dut_nr_inst = 0;
 
+// With CONFIG_PMEM_MEMFD and a REF supporting it, the REF maps pmem of
+// DUT copy-on-write instead of keeping its own copy.
+static bool mem_shared = false;
+static void (*ref_difftest_memsync)(paddr_t addr, size_t n) = NULL;
+
+// the last memory write of the current instruction
+static struct {
+  paddr_t addr;
+  int len;
+  word_t data;
+} last_write = {};
+
+#if defined(CONFIG_DIFFTEST_BATCH) || defined(CONFIG_DIFFTEST_ASYNC)
+// optional, run `n` instructions and report what each of them writes
+static void (*ref_difftest_exec_commit)(uint64_t n, diff_commit_t *log) = NULL;
+
+static void make_commit(diff_commit_t *c, vaddr_t pc) {
+  word_t data;
+  c->pc = pc;
+  c->rd = isa_difftest_commit(pc, &data);
+  c->data = data;
+  c->wlen = last_write.len;
+  c->waddr = last_write.addr;
+  c->wdata = last_write.data;
+}
+
+static bool commit_equal(diff_commit_t *ref, diff_commit_t *dut) {
+  return ref->pc == dut->pc && ref->rd == dut->rd && ref->data == dut->data && ref->wlen == dut->wlen &&
+    (ref->wlen == 0 || (ref->waddr == dut->waddr && ref->wdata == dut->wdata));
+}
+
+static void commit_report(diff_commit_t *ref, diff_commit_t *dut) {
+  Log("Commit log mismatch: REF writes x%d = " FMT_WORD " at pc = " FMT_WORD
+      ", DUT writes x%d = " FMT_WORD " at pc = " FMT_WORD,
+      ref->rd, (word_t)ref->data, (word_t)ref->pc, dut->rd, (word_t)dut->data, (word_t)dut->pc);
+  if (ref->wlen != 0 || dut->wlen != 0) {
+    Log("REF writes %d bytes " FMT_WORD " to " FMT_PADDR ", DUT writes %d bytes " FMT_WORD " to " FMT_PADDR,
+        ref->wlen, (word_t)ref->wdata, (paddr_t)ref->waddr, dut->wlen, (word_t)dut->wdata, (paddr_t)dut->waddr);
+  }
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_ASYNC
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// The DUT pushes a commit record of every instruction into a single-
+// producer single-consumer queue, and the checker thread runs REF with
+// ref_difftest_exec_commit() to compare with them. Everything else which
+// uses REF, such as skipping an instruction or raising an interrupt,
+// first waits for the checker to drain the queue and then calls REF
+// directly. A side waiting for the other spins for a while, and then
+// sleeps until it is woken up, so an idle guest does not keep a host
+// core busy.
+
+#define QUEUE_SIZE CONFIG_DIFFTEST_ASYNC_QUEUE
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+#define PUBLISH_INTERVAL 256 // records
+#define CHECK_CHUNK 1024     // records
+#define IDLE_SPIN 1000       // sched_yield() before sleeping
+
+static_assert((QUEUE_SIZE & QUEUE_MASK) == 0, "DIFFTEST_ASYNC_QUEUE is not a power of 2");
+
+static bool async = false; // the checker is started
+static diff_commit_t queue[QUEUE_SIZE];
+// free-running counters, on separate cache lines
+static _Atomic uint64_t q_tail __attribute__((aligned(64))) = 0;
+static _Atomic uint64_t q_head __attribute__((aligned(64))) = 0;
+static _Atomic bool async_failed = false;
+static struct { diff_commit_t ref, dut; uint64_t idx; } failure;
+// set by a side before sleeping, used as the futex word
+static _Atomic uint32_t checker_sleeping = 0, dut_sleeping = 0;
+// private to DUT
+static uint64_t tail = 0, head_cache = 0;
+
+// wait until `*counter` is no longer `val` or the check fails
+static void wait_change(_Atomic uint64_t *counter, uint64_t val, _Atomic uint32_t *sleeping) {
+  for (int i = 0; atomic_load_explicit(counter, memory_order_acquire) == val; i ++) {
+    if (atomic_load(&async_failed)) return;
+    if (i < IDLE_SPIN) { sched_yield(); continue; }
+    atomic_store(sleeping, 1);
+    // the other side changes the counter or the failure flag before waking
+    if (atomic_load(counter) == val && !atomic_load(&async_failed)) {
+      syscall(SYS_futex, sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+    atomic_store(sleeping, 0);
+  }
+}
+
+static void wake(_Atomic uint32_t *sleeping) {
+  if (atomic_load(sleeping) && atomic_exchange(sleeping, 0)) {
+    syscall(SYS_futex, sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+static void *checker(void *arg) {
+  static diff_commit_t log[CHECK_CHUNK];
+  uint64_t head = 0;
+  while (true) {
+    uint64_t n = atomic_load_explicit(&q_tail, memory_order_acquire) - head;
+    if (n == 0) { wait_change(&q_tail, head, &checker_sleeping); continue; }
+    if (n > CHECK_CHUNK) n = CHECK_CHUNK;
+    ref_difftest_exec_commit(n, log);
+    for (uint64_t i = 0; i < n; i ++) {
+      diff_commit_t *dut = &queue[(head + i) & QUEUE_MASK];
+      if (!commit_equal(&log[i], dut)) {
+        failure.ref = log[i];
+        failure.dut = *dut;
+        failure.idx = head + i;
+        atomic_store(&async_failed, true);
+        wake(&dut_sleeping);
+        return NULL;
+      }
+    }
+    head += n;
+    atomic_store(&q_head, head);
+    wake(&dut_sleeping);
+  }
+}
+
+static void async_publish() {
+  atomic_store(&q_tail, tail);
+  wake(&checker_sleeping);
+}
+
+static bool async_check_failed() {
+  return atomic_load_explicit(&async_failed, memory_order_acquire);
+}
+
+static void async_push(vaddr_t pc) {
+  if (unlikely(tail - head_cache == QUEUE_SIZE)) {
+    async_publish();
+    while ((head_cache = atomic_load_explicit(&q_head, memory_order_acquire)) + QUEUE_SIZE == tail) {
+      if (async_check_failed()) return;
+      wait_change(&q_head, head_cache, &dut_sleeping);
+    }
+  }
+  make_commit(&queue[tail & QUEUE_MASK], pc);
+  tail ++;
+  if (tail % PUBLISH_INTERVAL == 0) async_publish();
+}
+
+// wait until the checker is idle, return false on mismatch
+static bool async_drain() {
+  if (!async) return true;
+  async_publish();
+  uint64_t head;
+  while ((head = atomic_load_explicit(&q_head, memory_order_acquire)) != tail) {
+    if (async_check_failed()) return false;
+    wait_change(&q_head, head, &dut_sleeping);
+  }
+  return true;
+}
+
+static void async_abort() {
+  Log("Mismatch at the %" PRIu64 "-th checked instruction, pc = " FMT_WORD,
+      failure.idx + 1, (word_t)failure.dut.pc);
+  commit_report(&failure.ref, &failure.dut);
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = failure.dut.pc;
+}
+
+static void init_async() {
+  Assert(ref_difftest_exec_commit != NULL, "REF does not support difftest_exec_commit(), "
+      "which is required by CONFIG_DIFFTEST_ASYNC");
+  async = true;
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, checker, NULL);
+  assert(ret == 0);
+  pthread_detach(thread);
+  Log("Checking with REF in a separate thread");
+}
+
+bool difftest_sync() {
+  if (async_drain()) return true;
+  async_abort();
+  return false;
+}
+
+static bool block_end(bool force) {
+  if (unlikely(async_check_failed())) {
+    async_abort();
+    return false;
+  }
+  return true;
+}
+#endif
+
+static void ref_memsync(paddr_t addr, size_t n) {
+  if (mem_shared) ref_difftest_memsync(addr, n);
+  else ref_difftest_memcpy(addr, guest_to_host(addr), n, DIFFTEST_TO_REF);
+}
+
+#ifdef CONFIG_DIFFTEST_BATCH
+// In batch mode the REF is only advanced and compared at block ends,
+// once `batch` instructions are pending. `batch` doubles while both sides
+// agree. On a mismatch, the DUT is rolled back to the last agreeing point
+// with the snapshot and the undo log of memory writes, the REF is reset to
+// the same state, and the pending instructions are replayed one by one to
+// find the first one that differs.
+// Note that device accesses are performed again during the replay.
+// The instruction count, and so the virtual time, and the traces are
+// also rolled back. Events are only handled after a forced catch up, so
+// none of them is in the instructions rolled back.
+
+#define UNDO_SIZE (2 * CONFIG_DIFFTEST_BATCH_MAX)
+
+static uint32_t batch = 1;
+static uint32_t nr_pending = 0;
+static uint32_t nr_replay = 0;
+static bool need_rollback = false;
+static CPU_state snapshot = {};
+static vaddr_t snapshot_pc = 0;
+static uint64_t snapshot_nr_inst = 0;
+// pc of the last pending instruction
+static vaddr_t pending_pc = 0;
+
+static struct {
+  paddr_t addr;
+  int len;
+  word_t data;
+} undo[UNDO_SIZE];
+static int nr_undo = 0;
+static bool undo_overflow = false;
+
+// optional, run until `pc` has been reached `hits` times
+static void (*ref_difftest_exec_until)(uint64_t pc, uint64_t hits) = NULL;
+// optional, copy the whole CPU_state including what difftest_regcpy() does not
+static void (*ref_difftest_statecpy)(void *dut, size_t size, bool direction) = NULL;
+// pc after each pending instruction, for ref_difftest_exec_until()
+static vaddr_t pending_npc[UNDO_SIZE];
+// writes of each pending instruction, for ref_difftest_exec_commit()
+static diff_commit_t pending_commit[UNDO_SIZE];
+
+static void undo_log_write(paddr_t addr, int len) {
+  if (unlikely(nr_undo == UNDO_SIZE)) { undo_overflow = true; return; }
+  undo[nr_undo].addr = addr;
+  undo[nr_undo].len = len;
+  undo[nr_undo].data = host_read(guest_to_host(addr), len);
+  nr_undo ++;
+}
+
+// Exchange the logged values with the current ones in memory. Doing it
+// backward restores the memory to the last checkpoint, and doing it again
+// forward redoes the writes. With shared memory, REF should not see the
+// writes of DUT which it has not executed yet.
+static void swap_undo_log(bool backward) {
+  for (int k = 0; k < nr_undo; k ++) {
+    int i = (backward ? nr_undo - 1 - k : k);
+    uint8_t *p = guest_to_host(undo[i].addr);
+    word_t data = host_read(p, undo[i].len);
+    host_write(p, undo[i].len, undo[i].data);
+    undo[i].data = data;
+  }
+}
+
+static void checkpoint() {
+  snapshot = cpu;
+  snapshot_pc = cpu.pc;
+  snapshot_nr_inst = g_nr_guest_inst;
+  nr_undo = 0;
+  undo_overflow = false;
+  IFDEF(CONFIG_ITRACE, itrace_checkpoint());
+  IFDEF(CONFIG_FTRACE, ftrace_checkpoint());
+  IFDEF(CONFIG_CTRACE, ctrace_checkpoint());
+}
+
+// With the commit log of REF, every pending instruction is checked,
+// including the register writes overwritten before the end of the batch.
+static bool ref_exec_commit() {
+  static diff_commit_t log[UNDO_SIZE];
+  ref_difftest_exec_commit(nr_pending, log);
+  for (uint32_t i = 0; i < nr_pending; i ++) {
+    if (!commit_equal(&log[i], &pending_commit[i])) {
+      commit_report(&log[i], &pending_commit[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// For REFs which are slow to execute a given number of instructions,
+// such as QEMU over GDB, run to the current pc with a breakpoint. It is
+// reached the same number of times as in the pending instructions.
+static bool ref_exec_pending() {
+  bool recorded = (nr_pending <= UNDO_SIZE);
+  if (ref_difftest_exec_commit != NULL && recorded) return ref_exec_commit();
+  if (ref_difftest_exec_until == NULL || !recorded) {
+    ref_difftest_exec(nr_pending);
+    return true;
+  }
+  uint64_t hits = 0;
+  for (uint32_t i = 0; i < nr_pending; i ++) hits += (pending_npc[i] == cpu.pc);
+  // every hit takes a step off the breakpoint and a continue
+  if (2 * hits < nr_pending) ref_difftest_exec_until(cpu.pc, hits);
+  else ref_difftest_exec(nr_pending);
+  return true;
+}
+
+// advance the REF to the DUT and compare, return false on mismatch
+static bool catch_up() {
+  if (nr_pending == 0) return true;
+  CPU_state ref_r;
+  if (mem_shared) swap_undo_log(true);
+  bool ok = ref_exec_pending();
+  if (mem_shared) swap_undo_log(false);
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  if (ok && isa_difftest_checkregs(&ref_r, pending_pc)) {
+    nr_pending = 0;
+    if (batch < CONFIG_DIFFTEST_BATCH_MAX) batch <<= 1;
+    checkpoint();
+    return true;
+  }
+  return false;
+}
+
+// whether the state after the registers of difftest_regcpy(), such as
+// CSRs, is changed since the checkpoint
+static bool extra_state_changed() {
+  return memcmp((uint8_t *)&cpu + DIFFTEST_REG_SIZE, (uint8_t *)&snapshot + DIFFTEST_REG_SIZE,
+      sizeof(cpu) - DIFFTEST_REG_SIZE) != 0;
+}
+
+static void rollback() {
+  const char *reason = NULL;
+  if (undo_overflow) reason = "there are too many memory writes to replay them";
+  else if (ref_difftest_statecpy == NULL && extra_state_changed()) reason = "REF can not restore the CSRs they change";
+  if (reason != NULL) {
+    Log("Mismatch within %d instructions after pc = " FMT_WORD ", but %s", nr_pending, snapshot_pc, reason);
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = cpu.pc;
+    isa_reg_display();
+    return;
+  }
+  Log("Mismatch within %d instructions after pc = " FMT_WORD ", replaying them step by step",
+      nr_pending, snapshot_pc);
+  swap_undo_log(true);
+  cpu = snapshot;
+  g_nr_guest_inst = snapshot_nr_inst;
+  IFDEF(CONFIG_ITRACE, itrace_rollback());
+  IFDEF(CONFIG_FTRACE, ftrace_rollback());
+  IFDEF(CONFIG_CTRACE, ctrace_rollback());
+  // so is a halt by the instructions rolled back
+  nemu_state.state = NEMU_RUNNING;
+  // REF is assumed to write the same locations as DUT
+  for (int i = 0; i < nr_undo; i ++) ref_memsync(undo[i].addr, undo[i].len);
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  if (ref_difftest_statecpy != NULL) ref_difftest_statecpy(&cpu, sizeof(cpu), DIFFTEST_TO_REF);
+  nr_replay = nr_pending;
+  nr_pending = 0;
+  batch = 1;
+  checkpoint();
+}
+
+bool difftest_sync() {
+  if (catch_up()) return true;
+  rollback();
+  return false;
+}
+
+static bool block_end(bool force) {
+  if (nr_pending >= batch || nr_undo >= UNDO_SIZE / 2 || (force && nr_pending > 0)) {
+    return difftest_sync();
+  }
+  return true;
+}
+#endif
+
+#if !defined(CONFIG_DIFFTEST_BATCH) && !defined(CONFIG_DIFFTEST_ASYNC)
+bool difftest_sync() { return true; }
+static bool block_end(bool force) { return true; }
+#endif
+
+// let REF see the content of [addr, addr + n) in DUT, such as written by DMA
+void difftest_resync(paddr_t addr, size_t n) {
+  IFDEF(CONFIG_DIFFTEST_ASYNC, async_drain());
+  // REF should execute the pending instructions with the old content. The
+  // write is not in the undo log, but it happens at the checkpoint.
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!catch_up()) need_rollback = true);
+  ref_memsync(addr, n);
+}
+
+#ifdef CONFIG_DIFFTEST_MEMHASH
+#include <memory/hash.h>
+
+// Every CONFIG_DIFFTEST_MEMHASH_INTERVAL instructions, the pages written by
+// DUT since the last check are hashed on both sides and compared. The pc
+// of the last instruction writing each 64-byte line is kept to tell who
+// corrupts the memory.
+
+#define HASH_PAGE DIFFTEST_HASH_PAGE
+#define NR_HASH_PAGE (CONFIG_MSIZE / HASH_PAGE)
+#define LINE_SHIFT 6
+
+static uint64_t dirty[(NR_HASH_PAGE + 63) / 64] = {};
+static vaddr_t *last_writer = NULL;
+static uint64_t next_memhash = CONFIG_DIFFTEST_MEMHASH_INTERVAL;
+// hash `nr_page` pages from `addr` with mem_hash()
+static void (*ref_difftest_memhash)(paddr_t addr, size_t nr_page, uint64_t *hash) = NULL;
+
+static void memhash_log_write(paddr_t addr, int len) {
+  paddr_t l = addr - CONFIG_MBASE, r = l + len - 1;
+  dirty[l / HASH_PAGE / 64] |= 1ull << (l / HASH_PAGE % 64);
+  last_writer[l >> LINE_SHIFT] = cpu.pc;
+  // a misaligned write may cross the line
+  if (unlikely((l ^ r) >> LINE_SHIFT)) {
+    dirty[r / HASH_PAGE / 64] |= 1ull << (r / HASH_PAGE % 64);
+    last_writer[r >> LINE_SHIFT] = cpu.pc;
+  }
+}
+
+// compare the page at `page` byte by byte, return false on mismatch
+static bool memhash_compare(paddr_t page) {
+  static uint8_t ref_page[HASH_PAGE];
+  ref_difftest_memcpy(page, ref_page, HASH_PAGE, DIFFTEST_TO_DUT);
+  uint8_t *dut_page = guest_to_host(page);
+  int i = 0;
+  while (i < HASH_PAGE && ref_page[i] == dut_page[i]) i ++;
+  if (i == HASH_PAGE) return true;
+
+  int w = i & ~(int)(sizeof(word_t) - 1);
+  paddr_t addr = page + i;
+  Log("Memory is different at " FMT_PADDR ", right = " FMT_WORD ", wrong = " FMT_WORD
+      " in the word at " FMT_PADDR, addr, host_read(ref_page + w, sizeof(word_t)),
+      host_read(dut_page + w, sizeof(word_t)), page + w);
+  vaddr_t pc = last_writer[(addr - CONFIG_MBASE) >> LINE_SHIFT];
+  Log("The last instruction writing around it in DUT is at pc = " FMT_WORD, pc);
+  return false;
+}
+
+static bool memhash_check() {
+  // REF should have executed the same instructions, try again later if not
+  if (skip_dut_nr_inst > 0) return true;
+  next_memhash = g_nr_guest_inst + CONFIG_DIFFTEST_MEMHASH_INTERVAL;
+  if (!difftest_sync()) return false;
+  for (int k = 0; k < ARRLEN(dirty); k ++) {
+    uint64_t bits = dirty[k];
+    dirty[k] = 0;
+    for (; bits != 0; bits &= bits - 1) {
+      paddr_t page = CONFIG_MBASE + (k * 64 + __builtin_ctzll(bits)) * HASH_PAGE;
+      uint64_t hash;
+      ref_difftest_memhash(page, 1, &hash);
+      if (hash != mem_hash(guest_to_host(page), HASH_PAGE) && !memhash_compare(page)) {
+        nemu_state.state = NEMU_ABORT;
+        nemu_state.halt_pc = cpu.pc;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void init_memhash(void *handle) {
+  ref_difftest_memhash = dlsym(handle, "difftest_memhash");
+  Assert(ref_difftest_memhash != NULL, "REF does not support difftest_memhash(), "
+      "which is required by CONFIG_DIFFTEST_MEMHASH");
+  last_writer = calloc(CONFIG_MSIZE >> LINE_SHIFT, sizeof(last_writer[0]));
+  assert(last_writer);
+}
+#endif
+
+void difftest_log_write(paddr_t addr, int len, word_t data) {
+  last_write.addr = addr;
+  last_write.len = len;
+  last_write.data = data & (~0ull >> (64 - 8 * len));
+  IFDEF(CONFIG_DIFFTEST_BATCH, undo_log_write(addr, len));
+  IFDEF(CONFIG_DIFFTEST_MEMHASH, memhash_log_write(addr, len));
+}
+
+// `force` is set when devices or interrupts are about to change the state
+bool difftest_block_end(bool force) {
+  if (!block_end(force)) return false;
+#ifdef CONFIG_DIFFTEST_MEMHASH
+  if (unlikely(g_nr_guest_inst >= next_memhash)) return memhash_check();
+#endif
+  return true;
+}
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
+  // let REF catch up with the instructions before this one
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!catch_up()) need_rollback = true);
+  IFDEF(CONFIG_DIFFTEST_ASYNC, async_drain());
   is_skip_ref = true;
   // If such an instruction is one of the instruction packing in QEMU
   // (see below), we end the process of catching up with QEMU's pc to
@@ -52,6 +540,8 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!catch_up()) { need_rollback = true; return; });
+  IFDEF(CONFIG_DIFFTEST_ASYNC, async_drain());
   skip_dut_nr_inst += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -87,8 +577,37 @@ void init_difftest(char *ref_so_file, long img_size, int port) {
       "If it is not necessary, you can turn it off in menuconfig.", ref_so_file);
 
   ref_difftest_init(port);
-  ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
+
+  // REF runs behind DUT in a separate thread, and can not see its memory
+#if defined(CONFIG_PMEM_MEMFD) && !defined(CONFIG_DIFFTEST_ASYNC)
+  void (*ref_difftest_memshare)(int fd, size_t size) = dlsym(handle, "difftest_memshare");
+  ref_difftest_memsync = dlsym(handle, "difftest_memsync");
+  mem_shared = (ref_difftest_memshare != NULL && ref_difftest_memsync != NULL);
+  if (mem_shared) {
+    ref_difftest_memshare(pmem_memfd(), CONFIG_MSIZE);
+    Log("Guest memory is shared with the REF");
+  }
+#endif
+
+#if defined(CONFIG_DIFFTEST_BATCH) || defined(CONFIG_DIFFTEST_ASYNC)
+  ref_difftest_exec_commit = dlsym(handle, "difftest_exec_commit");
+#endif
+  IFDEF(CONFIG_DIFFTEST_BATCH, ref_difftest_exec_until = dlsym(handle, "difftest_exec_until"));
+  IFDEF(CONFIG_DIFFTEST_BATCH, ref_difftest_statecpy = dlsym(handle, "difftest_statecpy"));
+  IFDEF(CONFIG_DIFFTEST_MEMHASH, init_memhash(handle));
+
+  if (!mem_shared) {
+    ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
+  }
   ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
+  IFDEF(CONFIG_DIFFTEST_ASYNC, init_async());
+}
+
+void difftest_intr(word_t NO) {
+  IFDEF(CONFIG_DIFFTEST_ASYNC, async_drain());
+  ref_difftest_raise_intr(NO);
+  IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
@@ -99,9 +618,18 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
   }
 }
 
-void difftest_step(vaddr_t pc, vaddr_t npc) {
+static void step(vaddr_t pc, vaddr_t npc) {
   CPU_state ref_r;
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  if (need_rollback) {
+    need_rollback = false;
+    is_skip_ref = false;
+    rollback();
+    return;
+  }
+#endif
+
   if (skip_dut_nr_inst > 0) {
     ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
     if (ref_r.pc == npc) {
@@ -119,13 +647,46 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
     is_skip_ref = false;
+    IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
     return;
   }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  if (likely(nr_replay == 0)) {
+    if (nr_pending < UNDO_SIZE) {
+      if (ref_difftest_exec_until != NULL) pending_npc[nr_pending] = npc;
+      if (ref_difftest_exec_commit != NULL) make_commit(&pending_commit[nr_pending], pc);
+    }
+    pending_pc = pc;
+    nr_pending ++;
+    return;
+  }
+#endif
+
+  IFDEF(CONFIG_DIFFTEST_ASYNC, if (likely(async)) { async_push(pc); return; });
+
   ref_difftest_exec(1);
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
 
   checkregs(&ref_r, pc);
+
+#ifdef CONFIG_DIFFTEST_BATCH
+  checkpoint();
+  if (-- nr_replay == 0 && nemu_state.state != NEMU_ABORT) {
+    Log("The mismatch can not be reproduced step by step");
+  }
+#endif
+}
+
+void difftest_step(vaddr_t pc, vaddr_t npc) {
+  step(pc, npc);
+  last_write.len = 0;
+}
+
+uint64_t difftest_lag() {
+  IFDEF(CONFIG_DIFFTEST_BATCH, return nr_pending);
+  IFDEF(CONFIG_DIFFTEST_ASYNC, return tail - atomic_load_explicit(&q_head, memory_order_relaxed));
+  return 0;
 }
 #else
 void init_difftest(char *ref_so_file, long img_size, int port) { }
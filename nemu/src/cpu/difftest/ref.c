@@ -18,20 +18,106 @@
 #include <difftest-def.h>
 #include <memory/paddr.h>
 
+#include <memory/vaddr.h>
+#include <memory/hash.h>
+#include <sys/mman.h>
+
+// the registers visible to the DUT, a prefix of CPU_state
+typedef struct {
+  uint8_t data[DIFFTEST_REG_SIZE];
+} diff_context_t;
+
+static_assert(DIFFTEST_REG_SIZE <= sizeof(CPU_state), "CPU_state is smaller than the difftest context");
+
+// file descriptor of the DUT memory shared by difftest_memshare()
+static int dut_mem_fd = -1;
+
+// map [addr, addr + n) of the DUT memory copy-on-write, so that the
+// pages are shared until REF writes them
+static void map_dut_mem(paddr_t addr, size_t n) {
+  void *p = mmap(guest_to_host(addr), n, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_FIXED, dut_mem_fd, addr - CONFIG_MBASE);
+  Assert(p != MAP_FAILED, "Can not map DUT memory at " FMT_PADDR, addr);
+}
+
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  assert(0);
+  if (direction == DIFFTEST_TO_REF) memcpy(guest_to_host(addr), buf, n);
+  else memcpy(buf, guest_to_host(addr), n);
 }
 
 __EXPORT void difftest_regcpy(void *dut, bool direction) {
-  assert(0);
+  // fixed-size copy, which is inlined by the compiler
+  if (direction == DIFFTEST_TO_REF) memcpy(&cpu, dut, sizeof(diff_context_t));
+  else memcpy(dut, &cpu, sizeof(diff_context_t));
 }
 
 __EXPORT void difftest_exec(uint64_t n) {
-  assert(0);
+  cpu_exec(n);
+}
+
+// Extensions, only used when the DUT finds them.
+
+// Like difftest_regcpy(), but with the whole CPU_state such as CSRs. The
+// DUT should be NEMU of the same configuration.
+__EXPORT void difftest_statecpy(void *dut, size_t size, bool direction) {
+  Assert(size == sizeof(CPU_state), "DUT state size %zu does not match REF %zu", size, sizeof(CPU_state));
+  if (direction == DIFFTEST_TO_REF) memcpy(&cpu, dut, sizeof(CPU_state));
+  else memcpy(dut, &cpu, sizeof(CPU_state));
+}
+
+// Use the memory backed by `fd` as the initial content of pmem.
+__EXPORT void difftest_memshare(int fd, size_t size) {
+  Assert(size == CONFIG_MSIZE, "DUT memory size 0x%zx does not match REF 0x%x", size, CONFIG_MSIZE);
+  Assert(((uintptr_t)guest_to_host(CONFIG_MBASE) & PAGE_MASK) == 0, "pmem of REF is not page aligned");
+  dut_mem_fd = fd;
+  map_dut_mem(CONFIG_MBASE, CONFIG_MSIZE);
+}
+
+// Drop the private copy of the pages covering [addr, addr + n) and see the
+// DUT memory again. The other bytes in these pages should already agree.
+__EXPORT void difftest_memsync(paddr_t addr, size_t n) {
+  assert(dut_mem_fd >= 0);
+  paddr_t l = addr & ~PAGE_MASK;
+  paddr_t r = (addr + n + PAGE_MASK) & ~PAGE_MASK;
+  map_dut_mem(l, r - l);
+}
+
+// the record of the running instruction in difftest_exec_commit()
+static diff_commit_t *commit = NULL;
+
+void difftest_ref_log_write(paddr_t addr, int len, word_t data) {
+  if (commit == NULL) return;
+  commit->waddr = addr;
+  commit->wdata = data & (~0ull >> (64 - 8 * len));
+  commit->wlen = len;
+}
+
+void difftest_ref_commit(vaddr_t pc) {
+  if (commit == NULL) return;
+  word_t data;
+  commit->pc = pc;
+  commit->rd = isa_difftest_commit(pc, &data);
+  commit->data = data;
+  commit ++;
+}
+
+// Run `n` instructions and report what each of them writes.
+__EXPORT void difftest_exec_commit(uint64_t n, diff_commit_t *log) {
+  memset(log, 0, sizeof(log[0]) * n);
+  commit = log;
+  cpu_exec(n);
+  commit = NULL;
+}
+
+// Hash the `nr_page` pages from `addr` into `hash`, with mem_hash().
+__EXPORT void difftest_memhash(paddr_t addr, size_t nr_page, uint64_t *hash) {
+  for (size_t i = 0; i < nr_page; i ++) {
+    hash[i] = mem_hash(guest_to_host(addr + i * DIFFTEST_HASH_PAGE), DIFFTEST_HASH_PAGE);
+  }
 }
 
 __EXPORT void difftest_raise_intr(word_t NO) {
-  assert(0);
+  cpu.pc = isa_raise_intr(NO, cpu.pc);
 }
 
 __EXPORT void difftest_init(int port) {
@@ -0,0 +1,61 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <device/map.h>
+#include <device/event.h>
+#include <utils.h>
+
+// Core-local interruptor. mtime counts in us of the guest time,
+// and the timer interrupt is delivered by the event queue.
+
+#define CLINT_MSIP     0x0000
+#define CLINT_MTIMECMP 0x4000
+#define CLINT_MTIME    0xbff8
+#define CLINT_SIZE     0x10000
+
+static uint8_t *clint_base = NULL;
+static int timer_event = -1;
+
+#define REG64(off) (*(uint64_t *)(clint_base + (off)))
+
+static void update_mtip() {
+  uint64_t cmp = REG64(CLINT_MTIMECMP);
+  bool fire = get_guest_time() >= cmp;
+  riscv_set_mip(MIP_MTIP, fire);
+  if (fire) event_cancel(timer_event);
+  else event_schedule(timer_event, cmp);
+}
+
+static void clint_io_handler(uint32_t offset, int len, bool is_write) {
+  if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+    if (!is_write) REG64(CLINT_MTIME) = get_guest_time();
+  } else if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8) {
+    if (is_write) update_mtip();
+  } else if (offset < CLINT_MSIP + 4) {
+    if (is_write) riscv_set_mip(MIP_MSIP, *(uint32_t *)(clint_base + CLINT_MSIP) & 1);
+  }
+}
+
+static void clint_timeout() {
+  update_mtip();
+}
+
+void init_clint() {
+  clint_base = new_space(CLINT_SIZE);
+  REG64(CLINT_MTIMECMP) = UINT64_MAX;
+  add_mmio_map("clint", CONFIG_CLINT_MMIO, clint_base, CLINT_SIZE, clint_io_handler);
+  timer_event = add_event("clint", 0, clint_timeout);
+}
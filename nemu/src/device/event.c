@@ -0,0 +1,152 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/event.h>
+#include <utils.h>
+
+#define MAX_EVENT 16
+
+// In host time mode, the host clock is checked after this number of instructions.
+#define HOST_POLL_INTERVAL 4096
+
+typedef struct {
+  const char *name;
+  uint64_t when;
+  uint64_t period;
+  event_handler_t handler;
+  int pos; // index in the heap, -1 if the event is not armed
+  uint64_t count;
+} Event;
+
+static Event events[MAX_EVENT] = {};
+static int nr_event = 0;
+
+// min-heap of armed events ordered by their deadlines
+static int heap[MAX_EVENT] = {};
+static int heap_size = 0;
+
+uint64_t g_event_next = 0;
+extern uint64_t g_nr_guest_inst;
+
+static inline bool heap_less(int i, int j) {
+  return events[heap[i]].when < events[heap[j]].when;
+}
+
+static inline void heap_swap(int i, int j) {
+  int t = heap[i]; heap[i] = heap[j]; heap[j] = t;
+  events[heap[i]].pos = i;
+  events[heap[j]].pos = j;
+}
+
+static void sift_up(int i) {
+  while (i > 0 && heap_less(i, (i - 1) / 2)) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sift_down(int i) {
+  while (true) {
+    int l = 2 * i + 1, r = l + 1, min = i;
+    if (l < heap_size && heap_less(l, min)) min = l;
+    if (r < heap_size && heap_less(r, min)) min = r;
+    if (min == i) return;
+    heap_swap(i, min);
+    i = min;
+  }
+}
+
+static void heap_remove(int id) {
+  int i = events[id].pos;
+  heap_size --;
+  if (i != heap_size) {
+    heap_swap(i, heap_size);
+    sift_down(i);
+    sift_up(i);
+  }
+  events[id].pos = -1;
+}
+
+static void update_next() {
+#ifdef CONFIG_TIMER_VIRTUAL
+  // the deadline can be converted to an exact instruction count
+  if (heap_size == 0) { g_event_next = UINT64_MAX; return; }
+  uint64_t when = events[heap[0]].when;
+  g_event_next = (when * 1000 + CONFIG_TIMER_VIRTUAL_NS_PER_INST - 1) / CONFIG_TIMER_VIRTUAL_NS_PER_INST;
+#else
+  g_event_next = (heap_size == 0 ? UINT64_MAX : g_nr_guest_inst + HOST_POLL_INTERVAL);
+#endif
+}
+
+int add_event(const char *name, uint64_t period, event_handler_t handler) {
+  assert(nr_event < MAX_EVENT);
+  int id = nr_event ++;
+  events[id] = (Event){ .name = name, .period = period, .handler = handler, .pos = -1 };
+  if (period != 0) event_schedule(id, get_guest_time() + period);
+  return id;
+}
+
+void event_schedule(int id, uint64_t when) {
+  assert(id >= 0 && id < nr_event);
+  Event *e = &events[id];
+  e->when = when;
+  if (e->pos == -1) {
+    e->pos = heap_size;
+    heap[heap_size ++] = id;
+  } else {
+    sift_down(e->pos);
+  }
+  sift_up(e->pos);
+  update_next();
+}
+
+void event_cancel(int id) {
+  assert(id >= 0 && id < nr_event);
+  if (events[id].pos != -1) {
+    heap_remove(id);
+    update_next();
+  }
+}
+
+void event_update() {
+  uint64_t now = get_guest_time();
+  while (heap_size > 0) {
+    int id = heap[0];
+    Event *e = &events[id];
+    if (e->when > now) break;
+    heap_remove(id);
+    if (e->period != 0) {
+      // do not try to catch up with the missing periods if the host is too slow
+      e->when += e->period;
+      if (e->when <= now) e->when = now + e->period;
+      e->pos = heap_size;
+      heap[heap_size ++] = id;
+      sift_up(e->pos);
+    }
+    IFDEF(CONFIG_PROF, g_phase_name = e->name);
+    e->count ++;
+    e->handler();
+    IFDEF(CONFIG_PROF, g_phase_name = NULL);
+  }
+  update_next();
+}
+
+bool event_stat(int id, const char **name, uint64_t *count) {
+  if (id < 0 || id >= nr_event) return false;
+  *name = events[id].name;
+  *count = events[id].count;
+  return true;
+}
@@ -0,0 +1,148 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <device/map.h>
+#include <memory/paddr.h>
+
+// 2D accelerator: copies data into the GPU memory and renders canvas
+// trees (see `struct gpu_canvas` in amdev.h) into the frame buffer
+
+enum {
+  reg_cmd,
+  reg_dst,
+  reg_src,
+  reg_size,
+  reg_memsz,
+  reg_count,
+  nr_reg
+};
+
+enum { GPU_CMD_NONE, GPU_CMD_MEMCPY, GPU_CMD_RENDER };
+
+#define GPU_TEXTURE 1
+#define GPU_SUBTREE 2
+#define GPU_NULL    0xffffffff
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct {
+  uint16_t type, w, h, x1, y1, w1, h1;
+  uint32_t sibling;
+  union {
+    uint32_t child;
+    struct {
+      uint16_t w, h;
+      uint32_t pixels;
+    } __attribute__((packed)) texture;
+  };
+} __attribute__((packed)) Canvas;
+
+typedef struct {
+  uint32_t *pixels;
+  int w, h;
+} Surface;
+
+static uint32_t *gpu_base = NULL;
+static uint8_t *gpu_mem = NULL;
+static Surface screen = {};
+
+static void *gpu_ptr(uint32_t addr, uint64_t size) {
+  Assert(addr <= CONFIG_GPU_MEM_SIZE && size <= CONFIG_GPU_MEM_SIZE - addr,
+      "GPU memory access out of bound: [0x%x, 0x%" PRIx64 ")", addr, addr + size);
+  return gpu_mem + addr;
+}
+
+static void gpu_memcpy(uint32_t dst, paddr_t src, uint32_t size) {
+  Assert(in_pmem(src) && (uint64_t)size <= (uint64_t)PMEM_RIGHT - src + 1,
+      "GPU memcpy source [" FMT_PADDR ", 0x%" PRIx64 ") is not in pmem", src, (uint64_t)src + size);
+  memcpy(gpu_ptr(dst, size), guest_to_host(src), size);
+}
+
+// copy `tex` to the rectangle (x, y, w, h) of `dst`, scaling with the nearest pixel
+static void blit(Surface *dst, Surface *tex, int x, int y, int w, int h) {
+  int x0 = MAX(x, 0), y0 = MAX(y, 0);
+  int x1 = MIN(x + w, dst->w), y1 = MIN(y + h, dst->h);
+  if (x0 >= x1 || y0 >= y1) return;
+  if (w == tex->w && h == tex->h) {
+    for (int j = y0; j < y1; j ++) {
+      memcpy(&dst->pixels[j * dst->w + x0], &tex->pixels[(j - y) * tex->w + (x0 - x)],
+          (x1 - x0) * sizeof(uint32_t));
+    }
+    return;
+  }
+  for (int j = y0; j < y1; j ++) {
+    uint32_t *row = &tex->pixels[(int64_t)(j - y) * tex->h / h * tex->w];
+    for (int i = x0; i < x1; i ++) {
+      dst->pixels[j * dst->w + i] = row[(int64_t)(i - x) * tex->w / w];
+    }
+  }
+}
+
+static void render(Surface *dst, uint32_t node, int depth) {
+  Assert(depth < 64, "GPU canvas tree is too deep or has a cycle");
+  for (; node != GPU_NULL; ) {
+    Canvas *c = gpu_ptr(node, sizeof(Canvas));
+    switch (c->type) {
+      case GPU_TEXTURE: {
+        int w = c->texture.w, h = c->texture.h;
+        Surface tex = { .pixels = gpu_ptr(c->texture.pixels, (uint64_t)w * h * sizeof(uint32_t)), .w = w, .h = h };
+        blit(dst, &tex, c->x1, c->y1, c->w1, c->h1);
+        break;
+      }
+      case GPU_SUBTREE: {
+        if (c->w == 0 || c->h == 0) break;
+        Surface sub = { .w = c->w, .h = c->h };
+        // no larger than the GPU memory, which also keeps the indices in int
+        uint64_t size = (uint64_t)sub.w * sub.h * sizeof(uint32_t);
+        Assert(size <= CONFIG_GPU_MEM_SIZE, "GPU subtree canvas %dx%d at 0x%x is too large", sub.w, sub.h, node);
+        sub.pixels = calloc(size, 1);
+        assert(sub.pixels);
+        render(&sub, c->child, depth + 1);
+        blit(dst, &sub, c->x1, c->y1, c->w1, c->h1);
+        free(sub.pixels);
+        break;
+      }
+      default: panic("unknown GPU canvas type %d at 0x%x", c->type, node);
+    }
+    node = c->sibling;
+  }
+}
+
+static void gpu_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset != reg_cmd * sizeof(uint32_t)) return;
+  switch (gpu_base[reg_cmd]) {
+    case GPU_CMD_MEMCPY:
+      if (gpu_base[reg_size] != 0) gpu_memcpy(gpu_base[reg_dst], gpu_base[reg_src], gpu_base[reg_size]);
+      break;
+    case GPU_CMD_RENDER: render(&screen, gpu_base[reg_src], 0); break;
+    default: panic("unknown GPU command %d", gpu_base[reg_cmd]);
+  }
+  gpu_base[reg_cmd] = GPU_CMD_NONE;
+  gpu_base[reg_count] ++;
+}
+
+void init_gpu(void *fb, int w, int h) {
+  screen = (Surface) { .pixels = fb, .w = w, .h = h };
+
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  gpu_base = (uint32_t *)new_space(space_size);
+  gpu_base[reg_memsz] = CONFIG_GPU_MEM_SIZE;
+  add_mmio_map("gpu", CONFIG_GPU_CTL_MMIO, gpu_base, space_size, gpu_io_handler);
+
+  gpu_mem = new_space(CONFIG_GPU_MEM_SIZE);
+  add_mmio_map("gpu-mem", CONFIG_GPU_MEM_ADDR, gpu_mem, CONFIG_GPU_MEM_SIZE, NULL);
+}
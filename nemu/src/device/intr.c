@@ -14,6 +14,10 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <device/intr.h>
 
-void dev_raise_intr() {
+void plic_raise(int irq);
+
+void dev_raise_intr(int irq) {
+  IFDEF(CONFIG_HAS_PLIC, plic_raise(irq));
 }
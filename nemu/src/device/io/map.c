@@ -13,16 +13,29 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#define _GNU_SOURCE // memfd_create()
 #include <isa.h>
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#ifdef CONFIG_MEMEXPORT
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-#define IO_SPACE_MAX (2 * 1024 * 1024)
+#define IO_SPACE_MAX (8 * 1024 * 1024)
 
 static uint8_t *io_space = NULL;
 static uint8_t *p_space = NULL;
 
+#ifdef CONFIG_MEMEXPORT
+static int io_fd = -1;
+
+int io_space_memfd() { return io_fd; }
+uint32_t io_space_offset(void *space) { return (uint8_t *)space - io_space; }
+#endif
+
 uint8_t* new_space(int size) {
   uint8_t *p = p_space;
   // page aligned;
@@ -42,13 +55,36 @@ static void check_bound(IOMap *map, paddr_t addr) {
   }
 }
 
-static void invoke_callback(io_callback_t c, paddr_t offset, int len, bool is_write) {
-  if (c != NULL) { c(offset, len, is_write); }
+static void invoke_callback(IOMap *map, paddr_t offset, int len, bool is_write) {
+  if (map->callback == NULL) return;
+#ifdef CONFIG_PROF
+  int phase = g_phase;
+  const char *name = g_phase_name;
+  g_phase_name = map->name;
+  g_phase = PHASE_IO;
+#endif
+  map->callback(offset, len, is_write);
+#ifdef CONFIG_PROF
+  g_phase = phase;
+  g_phase_name = name;
+#endif
 }
 
 void init_map() {
+#ifdef CONFIG_MEMEXPORT
+  io_fd = memfd_create("nemu-io", MFD_ALLOW_SEALING);
+  Assert(io_fd >= 0, "Can not create memfd for the device space");
+  int ret = ftruncate(io_fd, IO_SPACE_MAX);
+  assert(ret == 0);
+  io_space = mmap(NULL, IO_SPACE_MAX, PROT_READ | PROT_WRITE, MAP_SHARED, io_fd, 0);
+  assert(io_space != MAP_FAILED);
+  // see init_mem()
+  ret = fcntl(io_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL);
+  assert(ret == 0);
+#else
   io_space = malloc(IO_SPACE_MAX);
   assert(io_space);
+#endif
   p_space = io_space;
 }
 
@@ -56,7 +92,7 @@ word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
-  invoke_callback(map->callback, offset, len, false); // prepare data to read
+  invoke_callback(map, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
   return ret;
 }
@@ -66,5 +102,5 @@ void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
-  invoke_callback(map->callback, offset, len, true);
+  invoke_callback(map, offset, len, true);
 }
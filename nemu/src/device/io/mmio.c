@@ -16,7 +16,7 @@
 #include <device/map.h>
 #include <memory/paddr.h>
 
-#define NR_MAP 16
+#define NR_MAP 32
 
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
@@ -53,6 +53,11 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
   nr_map ++;
 }
 
+IOMap* fetch_mmio_maps(int *n) {
+  *n = nr_map;
+  return maps;
+}
+
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
   return map_read(addr, len, fetch_mmio_map(addr));
@@ -90,7 +90,9 @@ static uint32_t *i8042_data_port_base = NULL;
 static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
-  i8042_data_port_base[0] = key_dequeue();
+  uint32_t key = key_dequeue();
+  host_input(&key, sizeof(key));
+  i8042_data_port_base[0] = key;
 }
 
 void init_i8042() {
@@ -0,0 +1,301 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <device/map.h>
+#include <device/event.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <utils.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+// Network interface with descriptor rings in guest memory.
+// The rings are indexed by free-running counters modulo `ring_size`.
+// The driver produces TX descriptors up to `tx_tail` and empty RX
+// buffers up to `rx_tail`; the device consumes them and advances the
+// corresponding `*_head`.
+
+enum {
+  reg_ctrl,       // write 1 to enable the device and reset the rings
+  reg_ring_size,  // number of descriptors in each ring, power of 2
+  reg_tx_base,
+  reg_tx_tail,    // doorbell
+  reg_tx_head,
+  reg_rx_base,
+  reg_rx_tail,    // doorbell
+  reg_rx_head,
+  reg_intr,       // pending causes, write to clear
+  reg_itr_pkts,   // raise the interrupt after this number of packets
+  reg_itr_us,     // or after this amount of time since the first one
+  reg_rx_drops,
+  reg_tx_drops,
+  nr_reg
+};
+
+#define NIC_INTR_RX 0x1
+#define NIC_INTR_TX 0x2
+
+#define DESC_DONE 0x1
+
+typedef struct {
+  uint32_t addr;
+  uint16_t len;
+  uint16_t flags;
+} NICDesc;
+
+#define MAX_PKT  2048
+#define NR_QUEUE 256
+
+// packets received from the backend but not yet in the RX ring
+static struct {
+  uint16_t len;
+  uint8_t data[MAX_PKT];
+} *queue = NULL;
+static int q_head = 0, q_count = 0;
+
+static uint32_t *nic_base = NULL;
+static int itr_event = -1;
+static uint32_t nr_unsignaled = 0;
+
+static void *dma_ptr(paddr_t addr, int len) {
+  Assert(in_pmem(addr) && (uint64_t)len <= (uint64_t)PMEM_RIGHT - addr + 1,
+      "NIC DMA [" FMT_PADDR ", " FMT_PADDR ") is not in pmem", addr, addr + len);
+  return guest_to_host(addr);
+}
+
+// memory written by the device should also be seen by the REF and the watchpoints
+static void dma_sync(paddr_t addr, int len) {
+  IFDEF(CONFIG_DIFFTEST, difftest_resync(addr, len));
+  IFDEF(CONFIG_WATCHPOINT, vaddr_dma_write(addr, len));
+}
+
+static NICDesc *desc(int reg_base, uint32_t idx) {
+  uint32_t i = idx & (nic_base[reg_ring_size] - 1);
+  return dma_ptr(nic_base[reg_base] + i * sizeof(NICDesc), sizeof(NICDesc));
+}
+
+static void queue_push(const uint8_t *buf, int len) {
+  if (q_count == NR_QUEUE || len > MAX_PKT) { nic_base[reg_rx_drops] ++; return; }
+  int i = (q_head + q_count) % NR_QUEUE;
+  queue[i].len = len;
+  memcpy(queue[i].data, buf, len);
+  q_count ++;
+}
+
+/* ---------------- backends ---------------- */
+
+#if defined(CONFIG_NIC_LOOPBACK)
+static void backend_init() {}
+static void backend_send(const uint8_t *buf, int len) { queue_push(buf, len); }
+static int backend_recv(uint8_t *buf) { return 0; }
+
+#elif defined(CONFIG_NIC_UNIX)
+// The first NEMU binds the socket, the second one connects to it.
+static int fd = -1, listen_fd = -1;
+
+static void backend_init() {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, CONFIG_NIC_UNIX_PATH, sizeof(addr.sun_path) - 1);
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  Assert(fd >= 0, "Can not create socket");
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    Log("NIC: connected to %s", CONFIG_NIC_UNIX_PATH);
+    return;
+  }
+  listen_fd = fd;
+  fd = -1;
+  unlink(CONFIG_NIC_UNIX_PATH);
+  int ret = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+  Assert(ret == 0, "Can not bind %s", CONFIG_NIC_UNIX_PATH);
+  ret = listen(listen_fd, 1);
+  assert(ret == 0);
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  Log("NIC: waiting for the peer at %s", CONFIG_NIC_UNIX_PATH);
+}
+
+static void backend_send(const uint8_t *buf, int len) {
+  // the peer may have gone, which should not kill NEMU with SIGPIPE
+  if (fd < 0 || send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) nic_base[reg_tx_drops] ++;
+}
+
+static int backend_recv(uint8_t *buf) {
+  if (fd < 0) {
+    if (listen_fd < 0) return 0;
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return 0;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    Log("NIC: peer connected");
+  }
+  int len = recv(fd, buf, MAX_PKT, MSG_DONTWAIT);
+  if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    // wait for another peer if this NEMU is the one which binds the socket
+    Log("NIC: peer disconnected");
+    close(fd);
+    fd = -1;
+  }
+  return (len > 0 ? len : 0);
+}
+
+#elif defined(CONFIG_NIC_TAP)
+static int fd = -1;
+
+static void backend_init() {
+  fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  Assert(fd >= 0, "Can not open /dev/net/tun");
+  struct ifreq ifr = { .ifr_flags = IFF_TAP | IFF_NO_PI };
+  strncpy(ifr.ifr_name, CONFIG_NIC_TAP_NAME, IFNAMSIZ - 1);
+  int ret = ioctl(fd, TUNSETIFF, &ifr);
+  Assert(ret == 0, "Can not attach to %s: %s", CONFIG_NIC_TAP_NAME, strerror(errno));
+  Log("NIC: attached to %s", ifr.ifr_name);
+}
+
+static void backend_send(const uint8_t *buf, int len) {
+  if (write(fd, buf, len) != len) nic_base[reg_tx_drops] ++;
+}
+
+static int backend_recv(uint8_t *buf) {
+  int len = read(fd, buf, MAX_PKT);
+  return (len > 0 ? len : 0);
+}
+#endif
+
+// The packets from the host are logged as inputs. With reverse execution,
+// the packets to the host are not sent again while replaying.
+static void send_pkt(const uint8_t *buf, int len) {
+#if defined(CONFIG_RR) && !defined(CONFIG_NIC_LOOPBACK)
+  if (rr_replaying()) return;
+#endif
+  backend_send(buf, len);
+}
+
+static int recv_pkt(uint8_t *buf) {
+  int len = (host_input_replayed() ? 0 : backend_recv(buf));
+  host_input(&len, sizeof(len));
+  if (len > 0) host_input(buf, len);
+  return len;
+}
+
+/* ---------------- rings ---------------- */
+
+static void raise_intr(uint32_t cause) {
+  nic_base[reg_intr] |= cause;
+  nr_unsignaled = 0;
+  event_cancel(itr_event);
+  dev_raise_intr(IRQ_NIC);
+}
+
+// interrupt coalescing
+static void rx_signal(int n) {
+  if (n == 0) return;
+  nr_unsignaled += n;
+  if (nr_unsignaled >= nic_base[reg_itr_pkts]) raise_intr(NIC_INTR_RX);
+  else if (nr_unsignaled == n && nic_base[reg_itr_us] != 0) {
+    event_schedule(itr_event, get_guest_time() + nic_base[reg_itr_us]);
+  }
+}
+
+static void itr_timeout() {
+  if (nr_unsignaled > 0) raise_intr(NIC_INTR_RX);
+}
+
+static void rx_deliver() {
+  int n = 0;
+  while (q_count > 0 && nic_base[reg_rx_head] != nic_base[reg_rx_tail]) {
+    NICDesc *d = desc(reg_rx_base, nic_base[reg_rx_head]);
+    int len = queue[q_head].len;
+    if (len <= d->len) {
+      memcpy(dma_ptr(d->addr, len), queue[q_head].data, len);
+      dma_sync(d->addr, len);
+      d->len = len;
+      d->flags = DESC_DONE;
+      dma_sync(host_to_guest((uint8_t *)d), sizeof(*d));
+      nic_base[reg_rx_head] ++;
+      n ++;
+    } else {
+      nic_base[reg_rx_drops] ++;
+    }
+    q_head = (q_head + 1) % NR_QUEUE;
+    q_count --;
+  }
+  rx_signal(n);
+}
+
+static void tx_process() {
+  int n = 0;
+  while (nic_base[reg_tx_head] != nic_base[reg_tx_tail]) {
+    NICDesc *d = desc(reg_tx_base, nic_base[reg_tx_head]);
+    // an empty packet is completed without DMA and counted as a drop
+    if (d->len > 0) send_pkt(dma_ptr(d->addr, d->len), d->len);
+    else nic_base[reg_tx_drops] ++;
+    d->flags = DESC_DONE;
+    dma_sync(host_to_guest((uint8_t *)d), sizeof(*d));
+    nic_base[reg_tx_head] ++;
+    n ++;
+  }
+  if (n > 0 && nic_base[reg_itr_pkts] <= 1) raise_intr(NIC_INTR_TX);
+}
+
+static bool enabled() { return nic_base[reg_ctrl] & 1; }
+
+static void nic_poll() {
+  if (!enabled()) return;
+  static uint8_t buf[MAX_PKT];
+  int len;
+  while (q_count < NR_QUEUE && (len = recv_pkt(buf)) > 0) {
+    queue_push(buf, len);
+  }
+  rx_deliver();
+}
+
+static void nic_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) return;
+  switch (offset / sizeof(uint32_t)) {
+    case reg_ctrl: {
+      uint32_t size = nic_base[reg_ring_size];
+      Assert(!enabled() || (size != 0 && (size & (size - 1)) == 0),
+          "NIC ring size %d is not a power of 2", size);
+      nic_base[reg_tx_head] = nic_base[reg_tx_tail] = 0;
+      nic_base[reg_rx_head] = nic_base[reg_rx_tail] = 0;
+      nr_unsignaled = 0;
+      break;
+    }
+    case reg_tx_tail: if (enabled()) { tx_process(); rx_deliver(); } break;
+    case reg_rx_tail: if (enabled()) rx_deliver(); break;
+    case reg_intr: nic_base[reg_intr] = 0; break;
+    default: break;
+  }
+}
+
+void init_nic() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  nic_base = (uint32_t *)new_space(space_size);
+  nic_base[reg_itr_pkts] = 1;
+  add_mmio_map("nic", CONFIG_NIC_CTL_MMIO, nic_base, space_size, nic_io_handler);
+
+  queue = malloc(sizeof(queue[0]) * NR_QUEUE);
+  assert(queue);
+  backend_init();
+  add_event("nic", CONFIG_NIC_POLL_US, nic_poll);
+  itr_event = add_event("nic-itr", 0, itr_timeout);
+}
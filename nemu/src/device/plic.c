@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <device/map.h>
+#include <device/intr.h>
+
+// Platform-level interrupt controller with a single context (M-mode of hart 0).
+// The base window holds the priorities, the pending bits and the enable bits;
+// the context window holds the threshold and the claim/complete register.
+
+#define PLIC_PRIORITY  0x0000
+#define PLIC_PENDING   0x1000
+#define PLIC_ENABLE    0x2000
+#define PLIC_SIZE      0x3000
+#define PLIC_CTX_OFF   0x200000
+#define PLIC_THRESHOLD 0x0
+#define PLIC_CLAIM     0x4
+#define PLIC_CTX_SIZE  0x8
+
+static uint32_t *plic_base = NULL;
+static uint32_t *ctx_base = NULL;
+static uint32_t pending = 0;
+static uint32_t in_service = 0;
+
+#define priority(irq) plic_base[(PLIC_PRIORITY / 4) + (irq)]
+#define enable        plic_base[PLIC_ENABLE / 4]
+#define threshold     ctx_base[PLIC_THRESHOLD / 4]
+#define claim         ctx_base[PLIC_CLAIM / 4]
+
+// the highest-priority source to deliver, 0 if none
+static int plic_best() {
+  uint32_t cand = pending & enable & ~in_service;
+  int best = 0;
+  uint32_t best_prio = threshold;
+  for (int irq = 1; irq < NR_IRQ; irq ++) {
+    if ((cand >> irq & 1) && priority(irq) > best_prio) {
+      best = irq;
+      best_prio = priority(irq);
+    }
+  }
+  return best;
+}
+
+static void plic_update() {
+  int best = plic_best();
+  claim = best;
+  riscv_set_mip(MIP_MEIP, best != 0);
+}
+
+void plic_raise(int irq) {
+  assert(irq > 0 && irq < NR_IRQ);
+  pending |= 1u << irq;
+  plic_update();
+}
+
+static void plic_io_handler(uint32_t offset, int len, bool is_write) {
+  // the pending bits are read-only for the guest
+  plic_base[PLIC_PENDING / 4] = pending;
+  if (is_write) plic_update();
+}
+
+static void plic_ctx_io_handler(uint32_t offset, int len, bool is_write) {
+  if (offset == PLIC_CLAIM) {
+    if (is_write) {
+      // complete
+      in_service &= ~(1u << (claim % NR_IRQ));
+    } else {
+      int irq = plic_best();
+      claim = irq;
+      if (irq != 0) {
+        pending &= ~(1u << irq);
+        in_service |= 1u << irq;
+      }
+      // `claim` holds the value to return; MEIP follows the remaining sources
+      riscv_set_mip(MIP_MEIP, plic_best() != 0);
+      return;
+    }
+  }
+  plic_update();
+}
+
+void init_plic() {
+  plic_base = (uint32_t *)new_space(PLIC_SIZE);
+  add_mmio_map("plic", CONFIG_PLIC_MMIO, plic_base, PLIC_SIZE, plic_io_handler);
+  ctx_base = (uint32_t *)new_space(PLIC_CTX_SIZE);
+  add_mmio_map("plic-ctx", CONFIG_PLIC_MMIO + PLIC_CTX_OFF, ctx_base, PLIC_CTX_SIZE, plic_ctx_io_handler);
+}
@@ -25,6 +25,8 @@ static uint8_t *serial_base = NULL;
 
 
 static void serial_putc(char ch) {
+  // shown before the replay
+  IFDEF(CONFIG_RR, if (rr_replaying()) return);
   MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
 }
 
@@ -0,0 +1,250 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <pthread.h>
+
+// number of frames that can wait for the writer thread
+#define NR_SLOT 4
+
+typedef struct {
+  uint32_t *pixels;
+  uint64_t id;
+} Frame;
+
+static Frame slot[NR_SLOT];
+static int head = 0, tail = 0, count = 0;
+static bool stop = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cond_empty = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+static int width = 0, height = 0;
+static uint64_t nr_sync = 0;
+static FILE *sum_fp = NULL;
+static FILE *out_fp = NULL;
+
+static FILE *open_output(const char *suffix) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s", CONFIG_VGA_DUMP_PATH, suffix);
+  FILE *fp = fopen(path, "wb");
+  Assert(fp, "Can not open '%s'", path);
+  return fp;
+}
+
+// FNV-1a, the same hash is used by native AM so that logs can be compared
+static uint64_t frame_checksum(const uint32_t *p, int n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  const uint8_t *b = (const uint8_t *)p;
+  for (int i = 0; i < n * 4; i ++) {
+    h = (h ^ b[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+#ifdef CONFIG_VGA_DUMP_Y4M
+static void write_y4m(const uint32_t *p) {
+  int n = width * height;
+  uint8_t *plane = malloc(n * 3);
+  assert(plane);
+  for (int i = 0; i < n; i ++) {
+    int r = (p[i] >> 16) & 0xff, g = (p[i] >> 8) & 0xff, b = p[i] & 0xff;
+    // BT.601 studio swing
+    plane[i        ] = ((  66 * r + 129 * g +  25 * b + 128) >> 8) +  16;
+    plane[i + n    ] = (( -38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+    plane[i + n * 2] = (( 112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+  }
+  fputs("FRAME\n", out_fp);
+  fwrite(plane, 1, n * 3, out_fp);
+  free(plane);
+}
+#endif
+
+#ifdef CONFIG_VGA_DUMP_PNG
+static uint32_t crc_table[256];
+
+static void init_crc_table() {
+  for (uint32_t i = 0; i < 256; i ++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k ++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *buf, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i ++) crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void write_chunk(FILE *fp, const char *type, const uint8_t *data, uint32_t len) {
+  uint8_t hdr[8];
+  put_be32(hdr, len);
+  memcpy(hdr + 4, type, 4);
+  uint32_t crc = crc32(crc32(0, hdr + 4, 4), data, len);
+  uint8_t tail[4];
+  put_be32(tail, crc);
+  fwrite(hdr, 1, 8, fp);
+  fwrite(data, 1, len, fp);
+  fwrite(tail, 1, 4, fp);
+}
+
+// encode with stored (uncompressed) deflate blocks, which keeps the
+// writer thread cheap and the output readable by any decoder
+static void write_png(const uint32_t *p, uint64_t id) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "-%06" PRIu64 ".png", id);
+  FILE *fp = open_output(suffix);
+
+  size_t row = 1 + width * 3;
+  size_t raw_len = row * height;
+  uint8_t *raw = malloc(raw_len);
+  assert(raw);
+  for (int y = 0; y < height; y ++) {
+    uint8_t *r = raw + y * row;
+    *r ++ = 0; // filter type: none
+    for (int x = 0; x < width; x ++) {
+      uint32_t c = p[y * width + x];
+      *r ++ = c >> 16; *r ++ = c >> 8; *r ++ = c;
+    }
+  }
+
+  size_t nr_block = (raw_len + 0xffff - 1) / 0xffff;
+  size_t z_len = 2 + nr_block * 5 + raw_len + 4;
+  uint8_t *z = malloc(z_len);
+  assert(z);
+  uint8_t *q = z;
+  *q ++ = 0x78; *q ++ = 0x01;
+  uint32_t a = 1, b = 0;
+  for (size_t off = 0; off < raw_len; off += 0xffff) {
+    uint32_t len = (raw_len - off < 0xffff ? raw_len - off : 0xffff);
+    *q ++ = (off + len == raw_len);
+    *q ++ = len; *q ++ = len >> 8;
+    *q ++ = ~len; *q ++ = ~len >> 8;
+    memcpy(q, raw + off, len);
+    q += len;
+    for (uint32_t i = 0; i < len; i ++) {
+      a = (a + raw[off + i]) % 65521;
+      b = (b + a) % 65521;
+    }
+  }
+  put_be32(q, (b << 16) | a);
+
+  static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  uint8_t ihdr[13] = {};
+  put_be32(ihdr, width);
+  put_be32(ihdr + 4, height);
+  ihdr[8] = 8; // bit depth
+  ihdr[9] = 2; // color type: RGB
+  fwrite(sig, 1, 8, fp);
+  write_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+  write_chunk(fp, "IDAT", z, z_len);
+  write_chunk(fp, "IEND", NULL, 0);
+  fclose(fp);
+  free(raw);
+  free(z);
+}
+#endif
+
+static void encode(Frame *f) {
+  int n = width * height;
+  fprintf(sum_fp, "%" PRIu64 " %016" PRIx64 "\n", f->id, frame_checksum(f->pixels, n));
+#if defined(CONFIG_VGA_DUMP_RAW)
+  fwrite(f->pixels, sizeof(uint32_t), n, out_fp);
+#elif defined(CONFIG_VGA_DUMP_Y4M)
+  write_y4m(f->pixels);
+#elif defined(CONFIG_VGA_DUMP_PNG)
+  write_png(f->pixels, f->id);
+#endif
+}
+
+static void *writer_thread(void *arg) {
+  pthread_mutex_lock(&lock);
+  while (true) {
+    while (count == 0 && !stop) pthread_cond_wait(&cond_full, &lock);
+    if (count == 0) break;
+    Frame *f = &slot[head];
+    pthread_mutex_unlock(&lock);
+
+    encode(f);
+
+    pthread_mutex_lock(&lock);
+    head = (head + 1) % NR_SLOT;
+    count --;
+    pthread_cond_signal(&cond_empty);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+// called by the guest thread on every sync
+void vga_dump_frame(const void *vmem) {
+  uint64_t id = nr_sync ++;
+  if (id % CONFIG_VGA_DUMP_INTERVAL != 0) return;
+
+  pthread_mutex_lock(&lock);
+  // never drop frames, otherwise the checksum log is not reproducible
+  while (count == NR_SLOT) pthread_cond_wait(&cond_empty, &lock);
+  Frame *f = &slot[tail];
+  pthread_mutex_unlock(&lock);
+
+  memcpy(f->pixels, vmem, width * height * sizeof(uint32_t));
+  f->id = id;
+
+  pthread_mutex_lock(&lock);
+  tail = (tail + 1) % NR_SLOT;
+  count ++;
+  pthread_cond_signal(&cond_full);
+  pthread_mutex_unlock(&lock);
+}
+
+static void fini_vga_dump() {
+  pthread_mutex_lock(&lock);
+  stop = true;
+  pthread_cond_signal(&cond_full);
+  pthread_mutex_unlock(&lock);
+  pthread_join(writer, NULL);
+  fclose(sum_fp);
+  if (out_fp) fclose(out_fp);
+  Log("VGA dump: %" PRIu64 " syncs, output prefix = %s", nr_sync, CONFIG_VGA_DUMP_PATH);
+}
+
+void init_vga_dump(int w, int h) {
+  width = w;
+  height = h;
+  for (int i = 0; i < NR_SLOT; i ++) {
+    slot[i].pixels = malloc(w * h * sizeof(uint32_t));
+    assert(slot[i].pixels);
+  }
+
+  sum_fp = open_output(".sum");
+#if defined(CONFIG_VGA_DUMP_RAW)
+  out_fp = open_output(".raw");
+#elif defined(CONFIG_VGA_DUMP_Y4M)
+  out_fp = open_output(".y4m");
+  fprintf(out_fp, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", w, h);
+#elif defined(CONFIG_VGA_DUMP_PNG)
+  init_crc_table();
+#endif
+
+  int ret = pthread_create(&writer, NULL, writer_thread, NULL);
+  Assert(ret == 0, "Can not create the VGA dump thread");
+  atexit(fini_vga_dump);
+}
@@ -70,22 +70,45 @@ static inline void update_screen() {
 #endif
 #endif
 
+#ifdef CONFIG_VGA_DUMP
+void vga_dump_frame(const void *vmem);
+void init_vga_dump(int w, int h);
+
+// capture on the write itself instead of the periodic update,
+// so that the dumped frames do not depend on the host speed
+static void vgactl_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write && offset == 4 && vgactl_port_base[1] != 0) {
+    vga_dump_frame(vmem);
+  }
+}
+#endif
+
 void vga_update_screen() {
-  // TODO: call `update_screen()` when the sync register is non-zero,
-  // then zero out the sync register
+  if (vgactl_port_base[1] != 0) {
+    IFDEF(CONFIG_VGA_SHOW_SCREEN, update_screen());
+    vgactl_port_base[1] = 0;
+  }
 }
 
 void init_vga() {
-  vgactl_port_base = (uint32_t *)new_space(8);
+  vgactl_port_base = (uint32_t *)new_space(12);
   vgactl_port_base[0] = (screen_width() << 16) | screen_height();
+  // optional devices for the guest to probe
+  vgactl_port_base[2] = MUXDEF(CONFIG_HAS_GPU, 0x1, 0) | MUXDEF(CONFIG_HAS_NIC, 0x2, 0);
 #ifdef CONFIG_HAS_PORT_IO
-  add_pio_map ("vgactl", CONFIG_VGA_CTL_PORT, vgactl_port_base, 8, NULL);
+  add_pio_map ("vgactl", CONFIG_VGA_CTL_PORT, vgactl_port_base, 12,
+      MUXDEF(CONFIG_VGA_DUMP, vgactl_io_handler, NULL));
 #else
-  add_mmio_map("vgactl", CONFIG_VGA_CTL_MMIO, vgactl_port_base, 8, NULL);
+  add_mmio_map("vgactl", CONFIG_VGA_CTL_MMIO, vgactl_port_base, 12,
+      MUXDEF(CONFIG_VGA_DUMP, vgactl_io_handler, NULL));
 #endif
 
   vmem = new_space(screen_size());
   add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), NULL);
   IFDEF(CONFIG_VGA_SHOW_SCREEN, init_screen());
   IFDEF(CONFIG_VGA_SHOW_SCREEN, memset(vmem, 0, screen_size()));
+  IFDEF(CONFIG_VGA_DUMP, init_vga_dump(screen_width(), screen_height()));
+
+  void init_gpu(void *fb, int w, int h);
+  IFDEF(CONFIG_HAS_GPU, init_gpu(vmem, screen_width(), screen_height()));
 }
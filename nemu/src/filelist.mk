@@ -21,6 +21,16 @@ DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
 LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
 
+ifdef CONFIG_DIFFTEST_ASYNC
+LIBS += -lpthread
+endif
+
+ifdef CONFIG_RR
+LIBS += -lpthread
+else
+SRCS-BLACKLIST-y += src/monitor/sdb/rr.c
+endif
+
 ifdef mainargs
 ASFLAGS += -DBIN_PATH=\"$(mainargs)\"
 endif
@@ -69,6 +69,21 @@ static int decode_exec(Decode *s) {
 }
 
 int isa_exec_once(Decode *s) {
+  PHASE(PHASE_FETCH);
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
-  return decode_exec(s);
+  PHASE(PHASE_DECODE);
+  int ret = decode_exec(s);
+  PHASE(PHASE_TRACE);
+  IFDEF(CONFIG_ITRACE, trace_inst(s->pc, s->isa.inst.val, 0));
+  return ret;
+}
+
+int isa_inst_class(const char *name) {
+  if (strcmp(name, "lw") == 0) return INST_LOAD;
+  if (strcmp(name, "sw") == 0) return INST_STORE;
+  return INST_OTHER;
+}
+
+int isa_inst_rd(uint32_t inst) {
+  return 0;
 }
@@ -15,11 +15,22 @@
 
 #include <isa.h>
 #include <cpu/difftest.h>
+#include <memory/vaddr.h>
 #include "../local-include/reg.h"
 
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc) {
-  return false;
+  bool ok = difftest_check_reg("pc", pc, ref_r->pc, cpu.pc);
+  for (int i = 0; i < ARRLEN(cpu.gpr); i ++) {
+    ok &= difftest_check_reg(reg_name(i), pc, ref_r->gpr[i], gpr(i));
+  }
+  return ok;
 }
 
 void isa_difftest_attach() {
 }
+
+int isa_difftest_commit(vaddr_t pc, word_t *data) {
+  int rd = isa_inst_rd(vaddr_ifetch(pc, 4));
+  *data = (rd != 0 ? gpr(rd) : 0);
+  return rd;
+}
@@ -21,6 +21,9 @@
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
+  word_t mstatus, mtvec, mepc, mcause, mscratch, mie, mip;
+  // mip & mie if mstatus.MIE is set, otherwise 0
+  word_t intr_pending;
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
@@ -32,4 +35,11 @@ typedef struct {
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
 
+// interrupt
+#define MIP_MSIP (1 << 3)
+#define MIP_MTIP (1 << 7)
+#define MIP_MEIP (1 << 11)
+void riscv_set_mip(word_t mask, bool level);
+#define isa_intr_pending() (cpu.intr_pending != 0)
+
 #endif
@@ -32,6 +32,8 @@ static void restart() {
 
   /* The zero register is always 0. */
   cpu.gpr[0] = 0;
+
+  cpu.mstatus = 0x1800; // MPP = M-mode
 }
 
 void init_isa() {
@@ -22,8 +22,6 @@
 #define Mr vaddr_read
 #define Mw vaddr_write
 
-extern void trace_inst(word_t pc, uint32_t inst);
-
 enum {
   TYPE_I, TYPE_U, TYPE_S,
   TYPE_N, TYPE_J, TYPE_B, 
@@ -54,6 +52,29 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
+enum { CSR_OP_W, CSR_OP_S, CSR_OP_C };
+
+static word_t csr_op(int csr, word_t val, int op) {
+  word_t old = csr_read(csr);
+  switch (op) {
+    case CSR_OP_S: val = old | val; break;
+    case CSR_OP_C: val = old & ~val; break;
+  }
+  csr_write(csr, val);
+  return old;
+}
+
+#ifdef CONFIG_FTRACE
+// a jump linking $ra is a call, and `jalr x0, 0(ra)` is a return
+static void ftrace_jump(Decode *s, int rd) {
+  if (rd == 1) ftrace_call(s->pc, s->dnpc);
+  else if (rd == 0 && s->isa.inst.val == 0x00008067) ftrace_ret(s->pc, s->dnpc);
+}
+#endif
+
+#define CSR  BITS(imm, 11, 0)
+#define ZIMM BITS(s->isa.inst.val, 19, 15)
+
 static int decode_exec(Decode *s) {
   int rd = 0;
   word_t src1 = 0, src2 = 0, imm = 0;
@@ -66,7 +87,7 @@ static int decode_exec(Decode *s) {
 }
 
   INSTPAT_START();
-  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, R(rd) = s->pc + 4; s->dnpc = s->pc + imm);
+  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, R(rd) = s->pc + 4; s->dnpc = s->pc + imm; IFDEF(CONFIG_FTRACE, ftrace_jump(s, rd)));
 
   INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, R(rd) = s->pc + imm);
   INSTPAT("??????? ????? ????? ??? ????? 01101 11", lui    , U, R(rd) = imm);
@@ -77,7 +98,7 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 000 ????? 00100 11", addi   , I, R(rd) = src1 + imm); 
   INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, R(rd) = SEXT(Mr(src1 + imm, 2), 16));
   INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, R(rd) = SEXT(Mr(src1 + imm, 4), 32));
-  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, R(rd) = s->pc + 4; s->dnpc = (src1 + (imm << 1)) & 0xfffffffe);
+  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, R(rd) = s->pc + 4; s->dnpc = (src1 + (imm << 1)) & 0xfffffffe; IFDEF(CONFIG_FTRACE, ftrace_jump(s, rd)));
   INSTPAT("??????? ????? ????? 010 ????? 00100 11", slti   , I, R(rd) = (sword_t)src1 < (sword_t)imm ? 1 : 0);
   INSTPAT("??????? ????? ????? 011 ????? 00100 11", sltiu  , I, R(rd) = (word_t)src1 < (word_t)imm ? 1 : 0);
   INSTPAT("0000000 ????? ????? 001 ????? 00100 11", slli   , I, R(rd) = (word_t)src1 << BITS(imm, 5, 0));
@@ -117,6 +138,16 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh     , S, Mw(src1 + imm, 2, src2));
   INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw     , S, Mw(src1 + imm, 4, src2));
 
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, R(rd) = csr_op(CSR, src1, CSR_OP_W));
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, R(rd) = csr_op(CSR, src1, CSR_OP_S));
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, R(rd) = csr_op(CSR, src1, CSR_OP_C));
+  INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi , I, R(rd) = csr_op(CSR, ZIMM, CSR_OP_W));
+  INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi , I, R(rd) = csr_op(CSR, ZIMM, CSR_OP_S));
+  INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci , I, R(rd) = csr_op(CSR, ZIMM, CSR_OP_C));
+
+  INSTPAT("0000000 00000 00000 000 00000 11100 11", ecall  , N, s->dnpc = isa_raise_intr(11, s->pc)); // from M-mode
+  INSTPAT("0011000 00010 00000 000 00000 11100 11", mret   , N, s->dnpc = riscv_mret());
+  INSTPAT("0001000 00101 00000 000 00000 11100 11", wfi    , N, ); // interrupts are checked at the end of the block
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
@@ -127,7 +158,38 @@ static int decode_exec(Decode *s) {
 }
 
 int isa_exec_once(Decode *s) {
+  PHASE(PHASE_FETCH);
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
-  IFDEF(CONFIG_ITRACE, trace_inst(s->pc, s->isa.inst.val));
-  return decode_exec(s);
+  PHASE(PHASE_DECODE);
+  int ret = decode_exec(s);
+  PHASE(PHASE_TRACE);
+  // the value of rd is recorded even if the instruction does not write it
+  IFDEF(CONFIG_ITRACE, trace_inst(s->pc, s->isa.inst.val,
+        R(BITS(s->isa.inst.val, 11, 7) & (ARRLEN(cpu.gpr) - 1))));
+  return ret;
+}
+
+int isa_inst_class(const char *name) {
+  static const struct { const char *name; int class; } table[] = {
+    { "lb", INST_LOAD }, { "lh", INST_LOAD }, { "lw", INST_LOAD }, { "lbu", INST_LOAD }, { "lhu", INST_LOAD },
+    { "sb", INST_STORE }, { "sh", INST_STORE }, { "sw", INST_STORE },
+    { "beq", INST_BRANCH }, { "bne", INST_BRANCH }, { "blt", INST_BRANCH }, { "bge", INST_BRANCH },
+    { "bltu", INST_BRANCH }, { "bgeu", INST_BRANCH },
+    { "jal", INST_JUMP }, { "jalr", INST_JUMP },
+  };
+  for (int i = 0; i < ARRLEN(table); i ++) {
+    if (strcmp(table[i].name, name) == 0) return table[i].class;
+  }
+  return INST_OTHER;
+}
+
+int isa_inst_rd(uint32_t inst) {
+  int rd = BITS(inst, 11, 7);
+  switch (BITS(inst, 6, 0)) {
+    case 0x37: case 0x17: case 0x6f: case 0x67: // lui, auipc, jal, jalr
+    case 0x03: case 0x13: case 0x33: case 0x2f: // load, op-imm, op, amo
+    case 0x1b: case 0x3b: return rd;            // op-imm-32, op-32
+    case 0x73: if (BITS(inst, 14, 12) != 0) return rd; // csr*, not ecall, mret, ...
+  }
+  return 0;
 }
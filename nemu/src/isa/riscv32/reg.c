@@ -27,6 +27,33 @@ void isa_reg_display() {
     for(int i = 0; i<32; i++){
     printf("register %s : 0x%x\n", regs[i], cpu.gpr[i]);
   }
+  printf("mstatus = " FMT_WORD " mie = " FMT_WORD " mip = " FMT_WORD "\n", cpu.mstatus, cpu.mie, cpu.mip);
+  printf("mtvec = " FMT_WORD " mepc = " FMT_WORD " mcause = " FMT_WORD "\n", cpu.mtvec, cpu.mepc, cpu.mcause);
+}
+
+static word_t *csr_ptr(int addr) {
+  switch (addr) {
+    case CSR_MSTATUS:  return &cpu.mstatus;
+    case CSR_MIE:      return &cpu.mie;
+    case CSR_MTVEC:    return &cpu.mtvec;
+    case CSR_MSCRATCH: return &cpu.mscratch;
+    case CSR_MEPC:     return &cpu.mepc;
+    case CSR_MCAUSE:   return &cpu.mcause;
+    case CSR_MIP:      return &cpu.mip;
+    default: panic("unsupported CSR 0x%03x at pc = " FMT_WORD, addr, cpu.pc);
+  }
+}
+
+word_t csr_read(int addr) {
+  if (addr == CSR_MHARTID) return 0;
+  return *csr_ptr(addr);
+}
+
+void csr_write(int addr, word_t val) {
+  // the pending bits of mip are driven by the CLINT and the PLIC
+  if (addr == CSR_MIP || addr == CSR_MHARTID) return;
+  *csr_ptr(addr) = val;
+  if (addr == CSR_MSTATUS || addr == CSR_MIE) riscv_update_intr();
 }
 
 word_t isa_reg_str2val(const char *s, bool *success) {
@@ -14,15 +14,42 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include "../local-include/reg.h"
+
+#define INTR_BIT (1ull << (sizeof(word_t) * 8 - 1))
+
+// fold the interrupt state into the word checked by the execution loop
+void riscv_update_intr() {
+  cpu.intr_pending = (cpu.mstatus & MSTATUS_MIE) ? (cpu.mip & cpu.mie) : 0;
+}
+
+void riscv_set_mip(word_t mask, bool level) {
+  if (level) cpu.mip |= mask;
+  else cpu.mip &= ~mask;
+  riscv_update_intr();
+}
 
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * Then return the address of the interrupt/exception vector.
-   */
+  cpu.mepc = epc;
+  cpu.mcause = NO;
+  word_t mie = (cpu.mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0;
+  cpu.mstatus = (cpu.mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | mie | MSTATUS_MPP;
+  riscv_update_intr();
+  return cpu.mtvec;
+}
 
-  return 0;
+vaddr_t riscv_mret() {
+  word_t mpie = (cpu.mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0;
+  cpu.mstatus = (cpu.mstatus & ~MSTATUS_MIE) | mpie | MSTATUS_MPIE;
+  riscv_update_intr();
+  return cpu.mepc;
 }
 
 word_t isa_query_intr() {
+  word_t p = cpu.intr_pending;
+  // priority: external > software > timer
+  if (p & MIP_MEIP) return INTR_BIT | 11;
+  if (p & MIP_MSIP) return INTR_BIT | 3;
+  if (p & MIP_MTIP) return INTR_BIT | 7;
   return INTR_EMPTY;
 }
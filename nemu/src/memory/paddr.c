@@ -13,13 +13,23 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#define _GNU_SOURCE // memfd_create()
 #include <memory/host.h>
 #include <memory/paddr.h>
 #include <device/mmio.h>
+#include <cpu/difftest.h>
 #include <isa.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #if   defined(CONFIG_PMEM_MALLOC)
 static uint8_t *pmem = NULL;
+#elif defined(CONFIG_PMEM_MEMFD)
+static uint8_t *pmem = NULL;
+static int pmem_fd = -1;
+
+int pmem_memfd() { return pmem_fd; }
 #else // CONFIG_PMEM_GARRAY
 static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
@@ -33,6 +43,9 @@ static word_t pmem_read(paddr_t addr, int len) {
 }
 
 static void pmem_write(paddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_DIFFTEST, difftest_log_write(addr, len, data));
+  IFDEF(CONFIG_TARGET_SHARE, difftest_ref_log_write(addr, len, data));
+  IFDEF(CONFIG_CTRACE, ctrace_log_write(addr, len, data));
   host_write(guest_to_host(addr), len, data);
 }
 
@@ -45,6 +58,17 @@ void init_mem() {
 #if   defined(CONFIG_PMEM_MALLOC)
   pmem = malloc(CONFIG_MSIZE);
   assert(pmem);
+#elif defined(CONFIG_PMEM_MEMFD)
+  pmem_fd = memfd_create("nemu-pmem", MFD_ALLOW_SEALING);
+  Assert(pmem_fd >= 0, "Can not create memfd for pmem");
+  int ret = ftruncate(pmem_fd, CONFIG_MSIZE);
+  assert(ret == 0);
+  pmem = mmap(NULL, CONFIG_MSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, pmem_fd, 0);
+  assert(pmem != MAP_FAILED);
+  // only the mapping above can write, others who get the fd can map it
+  // read-only or copy-on-write
+  ret = fcntl(pmem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL);
+  assert(ret == 0);
 #endif
 #ifdef CONFIG_MEM_RANDOM
   uint32_t *p = (uint32_t *)pmem;
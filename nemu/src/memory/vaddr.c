@@ -15,6 +15,7 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 
 word_t vaddr_ifetch(vaddr_t addr, int len) {
   return paddr_read(addr, len);
@@ -24,6 +25,45 @@ word_t vaddr_read(vaddr_t addr, int len) {
   return paddr_read(addr, len);
 }
 
+#ifdef CONFIG_WATCHPOINT
+// Pages holding data watchpoints, hashed into a small bitmap. A hit only
+// means the write may touch a watched range; the watchpoints check it.
+#define WATCH_PAGE_BITS 16
+static uint64_t watch_page[(1 << WATCH_PAGE_BITS) / 64] = {};
+
+static inline uint32_t watch_page_idx(vaddr_t addr) {
+  return (addr >> PAGE_SHIFT) & ((1 << WATCH_PAGE_BITS) - 1);
+}
+
+static inline bool watched(vaddr_t addr) {
+  uint32_t idx = watch_page_idx(addr);
+  return (watch_page[idx / 64] >> (idx % 64)) & 1;
+}
+
+void vaddr_watch_reset() {
+  memset(watch_page, 0, sizeof(watch_page));
+}
+
+void vaddr_watch(vaddr_t addr, int len) {
+  for (vaddr_t p = addr & ~PAGE_MASK; p <= addr + len - 1; p += PAGE_SIZE) {
+    uint32_t idx = watch_page_idx(p);
+    watch_page[idx / 64] |= 1ull << (idx % 64);
+  }
+}
+
+extern void check_data_wp(vaddr_t addr, int len, bool in_inst);
+
+// called after a device writes [addr, addr + len) of the guest memory
+void vaddr_dma_write(vaddr_t addr, int len) {
+  for (vaddr_t p = addr & ~PAGE_MASK; p <= addr + len - 1; p += PAGE_SIZE) {
+    if (watched(p)) { check_data_wp(addr, len, false); return; }
+  }
+}
+#endif
+
 void vaddr_write(vaddr_t addr, int len, word_t data) {
   paddr_write(addr, len, data);
+#ifdef CONFIG_WATCHPOINT
+  if (unlikely(watched(addr) || watched(addr + len - 1))) check_data_wp(addr, len, true);
+#endif
 }
@@ -23,6 +23,15 @@ void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
 void init_disasm(const char *triple);
+void init_ctrace(const char *file);
+void init_itrace(const char *dump_file);
+void init_elf(const char *file);
+void init_ftrace(const char *file);
+void init_prof();
+void init_metrics(const char *path);
+void init_memexport(const char *path);
+void init_rr();
+void init_replay(const char *record_file, const char *replay_file);
 
 static void welcome() {
   Log("Trace: %s", MUXDEF(CONFIG_TRACE, ANSI_FMT("ON", ANSI_FG_GREEN), ANSI_FMT("OFF", ANSI_FG_RED)));
@@ -44,6 +53,14 @@ void sdb_set_batch_mode();
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *ctrace_file = NULL;
+static char *itrace_file = NULL;
+static char *elf_file = NULL;
+static char *ftrace_file = NULL;
+static char *metrics_file = NULL;
+static char *memexport_file = NULL;
+static char *record_file = NULL;
+static char *replay_file = NULL;
 static int difftest_port = 1234;
 
 static long load_img() {
@@ -74,16 +91,32 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"ctrace"   , required_argument, NULL, 'c'},
+    {"itrace"   , required_argument, NULL, 'i'},
+    {"elf"      , required_argument, NULL, 'e'},
+    {"ftrace"   , required_argument, NULL, 'f'},
+    {"metrics"  , required_argument, NULL, 'm'},
+    {"memexport", required_argument, NULL, 'x'},
+    {"record"   , required_argument, NULL, 'r'},
+    {"replay"   , required_argument, NULL, 'R'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:c:i:e:f:m:x:r:R:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'c': ctrace_file = optarg; break;
+      case 'i': itrace_file = optarg; break;
+      case 'e': elf_file = optarg; break;
+      case 'f': ftrace_file = optarg; break;
+      case 'm': metrics_file = optarg; break;
+      case 'x': memexport_file = optarg; break;
+      case 'r': record_file = optarg; break;
+      case 'R': replay_file = optarg; break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -91,6 +124,14 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-c,--ctrace=FILE        write the commit trace to FILE\n");
+        printf("\t-i,--itrace=FILE        dump the recently executed instructions to FILE on failure\n");
+        printf("\t-e,--elf=FILE           read symbols of the program from FILE\n");
+        printf("\t-f,--ftrace=FILE        write the function calls and returns to FILE\n");
+        printf("\t-m,--metrics=PATH       serve live metrics at the Unix domain socket PATH\n");
+        printf("\t-x,--memexport=PATH     export the guest memory at the Unix domain socket PATH\n");
+        printf("\t-r,--record=FILE        record the inputs from the host to FILE\n");
+        printf("\t-R,--replay=FILE        replay the inputs from the host recorded in FILE\n");
         printf("\n");
         exit(0);
     }
@@ -110,6 +151,9 @@ void init_monitor(int argc, char *argv[]) {
   /* Open the log file. */
   init_log(log_file);
 
+  /* Record or replay the inputs from the host, before the devices take any. */
+  IFDEF(CONFIG_REPLAY, init_replay(record_file, replay_file));
+
   /* Initialize memory. */
   init_mem();
 
@@ -122,12 +166,36 @@ void init_monitor(int argc, char *argv[]) {
   /* Load the image to memory. This will overwrite the built-in image. */
   long img_size = load_img();
 
+  /* Open the commit trace. */
+  IFDEF(CONFIG_CTRACE, init_ctrace(ctrace_file));
+
+  /* Set where the instruction trace is dumped to. */
+  IFDEF(CONFIG_ITRACE, init_itrace(itrace_file));
+
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
   /* Initialize the simple debugger. */
   init_sdb();
 
+  /* Read the symbols of the program. */
+  init_elf(elf_file);
+
+  /* Open the function trace. */
+  IFDEF(CONFIG_FTRACE, init_ftrace(ftrace_file));
+
+  /* Start sampling the phases. */
+  IFDEF(CONFIG_PROF, init_prof());
+
+  /* Serve the live metrics. */
+  IFDEF(CONFIG_METRICS, init_metrics(metrics_file));
+
+  /* Export the guest memory. */
+  IFDEF(CONFIG_MEMEXPORT, init_memexport(memexport_file));
+
+  /* Fork the reaper of the processes for reverse execution. */
+  IFDEF(CONFIG_RR, init_rr());
+
 #ifndef CONFIG_ISA_loongarch32r
   IFDEF(CONFIG_ITRACE, init_disasm(
     MUXDEF(CONFIG_ISA_x86,     "i686",
@@ -0,0 +1,209 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <memory/vaddr.h>
+#include "sdb.h"
+
+typedef struct {
+  int NO;
+  vaddr_t pc;
+  bool temp;    // deleted after the first hit
+  char *cond;   // NULL if unconditional
+  Expr ex;
+  uint64_t hit;
+} BP;
+
+static BP *bp = NULL;
+static int nr_bp = 0, max_bp = 0, next_NO = 1;
+
+// An open-addressing hash set from pc to the index in bp[]. Deleted slots
+// are kept as tombstones until the set is rebuilt.
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
+
+typedef struct {
+  vaddr_t pc;
+  int idx;
+} Slot;
+
+static Slot *slot = NULL;
+static uint32_t slot_mask = 0;
+static int nr_used = 0; // including tombstones
+
+// Number of breakpoints in each code page, hashed. The engine only looks
+// up the set inside pages with breakpoints.
+#define BP_PAGE_BITS 12
+static uint16_t page_cnt[1 << BP_PAGE_BITS] = {};
+
+static inline uint32_t page_idx(vaddr_t pc) {
+  return (pc >> PAGE_SHIFT) & ((1 << BP_PAGE_BITS) - 1);
+}
+
+static inline uint32_t slot_hash(vaddr_t pc) {
+  return (uint32_t)(((uint64_t)pc * 0x9e3779b97f4a7c15ull) >> 32) & slot_mask;
+}
+
+// the slot holding `pc`, or NULL
+static Slot *slot_find(vaddr_t pc) {
+  if (slot == NULL) return NULL;
+  for (uint32_t h = slot_hash(pc); ; h = (h + 1) & slot_mask) {
+    if (slot[h].idx == SLOT_EMPTY) return NULL;
+    if (slot[h].idx >= 0 && slot[h].pc == pc) return &slot[h];
+  }
+}
+
+static void slot_insert(vaddr_t pc, int idx) {
+  uint32_t h = slot_hash(pc);
+  while (slot[h].idx >= 0) h = (h + 1) & slot_mask;
+  if (slot[h].idx == SLOT_EMPTY) nr_used ++;
+  slot[h] = (Slot) { .pc = pc, .idx = idx };
+}
+
+static void slot_rebuild(uint32_t size) {
+  free(slot);
+  slot = malloc(sizeof(Slot) * size);
+  assert(slot);
+  for (uint32_t i = 0; i < size; i ++) slot[i].idx = SLOT_EMPTY;
+  slot_mask = size - 1;
+  nr_used = 0;
+  for (int i = 0; i < nr_bp; i ++) slot_insert(bp[i].pc, i);
+}
+
+static BP *new_bp(vaddr_t pc) {
+  if (nr_bp == max_bp) {
+    max_bp = (max_bp == 0 ? 16 : max_bp * 2);
+    bp = realloc(bp, sizeof(BP) * max_bp);
+    assert(bp);
+  }
+  // keep the load factor below 1/2
+  if ((nr_used + 1) * 2 > (int)(slot_mask + 1)) {
+    uint32_t size = (slot == NULL ? 64 : slot_mask + 1);
+    while ((nr_bp + 1) * 4 > size) size *= 2;
+    slot_rebuild(size);
+  }
+  BP *b = &bp[nr_bp];
+  memset(b, 0, sizeof(*b));
+  b->NO = next_NO ++;
+  b->pc = pc;
+  slot_insert(pc, nr_bp);
+  nr_bp ++;
+  page_cnt[page_idx(pc)] ++;
+  return b;
+}
+
+static void free_bp(int idx) {
+  BP *b = &bp[idx];
+  page_cnt[page_idx(b->pc)] --;
+  slot_find(b->pc)->idx = SLOT_DELETED;
+  if (b->cond) { free(b->cond); expr_free(&b->ex); }
+  nr_bp --;
+  if (idx != nr_bp) {
+    bp[idx] = bp[nr_bp];
+    slot_find(bp[idx].pc)->idx = idx;
+  }
+}
+
+static void print_location(vaddr_t pc) {
+  word_t off;
+  const char *name = symbol_name(pc, &off);
+  printf(FMT_WORD, pc);
+  if (name) printf(" <%s+0x%" PRIx64 ">", name, (uint64_t)off);
+}
+
+// b LOCATION [if COND], where LOCATION is a symbol or an expression
+void set_bp(char *args, bool temp) {
+  char *cond = strstr(args, " if ");
+  if (cond) { *cond = '\0'; cond += 4; }
+  while (*args == ' ') args ++;
+
+  vaddr_t pc;
+  if (!symbol_addr(args, &pc)) {
+    bool success;
+    pc = expr(args, &success);
+    if (!success) { printf("Bad location: %s\n", args); return; }
+  }
+  Slot *s = slot_find(pc);
+  if (s) {
+    printf("Breakpoint %d is already at " FMT_WORD "\n", bp[s->idx].NO, pc);
+    return;
+  }
+
+  Expr ex;
+  if (cond && !expr_compile(cond, &ex)) {
+    printf("Bad condition: %s\n", cond);
+    return;
+  }
+  BP *b = new_bp(pc);
+  b->temp = temp;
+  if (cond) { b->cond = strdup(cond); b->ex = ex; }
+  IFDEF(CONFIG_RR, rr_journal("%s " FMT_WORD "%s%s", (temp ? "tb" : "b"), pc, (cond ? " if " : ""), (cond ? cond : "")));
+  printf("%s %d at ", (temp ? "Temporary breakpoint" : "Breakpoint"), b->NO);
+  print_location(pc);
+  if (cond) printf(" if %s", cond);
+  printf("\n");
+}
+
+void delete_bp(int NO) {
+  for (int i = 0; i < nr_bp; i ++) {
+    if (bp[i].NO == NO) {
+      printf("Delete breakpoint %d\n", NO);
+      free_bp(i);
+      IFDEF(CONFIG_RR, rr_journal("bd %d", NO));
+      return;
+    }
+  }
+  printf("No breakpoint %d.\n", NO);
+}
+
+void display_bp() {
+  printf("%-8s%-6s%-12s%-10s%s\n", "Num", "Temp", "Hit", "Address", "Condition");
+  for (int i = 0; i < nr_bp; i ++) {
+    BP *b = &bp[i];
+    printf("%-8d%-6s%-12" PRIu64, b->NO, (b->temp ? "y" : "n"), b->hit);
+    print_location(b->pc);
+    if (b->cond) printf("  if %s", b->cond);
+    printf("\n");
+  }
+}
+
+// whether the code page of `pc` has breakpoints, called at block entries
+bool bp_page(vaddr_t pc) {
+  return page_cnt[page_idx(pc)] != 0;
+}
+
+// called before the instruction at `pc` in a page with breakpoints,
+// return true and stop if a breakpoint is hit
+bool check_bp(vaddr_t pc) {
+  Slot *s = slot_find(pc);
+  if (s == NULL) return false;
+  BP *b = &bp[s->idx];
+  if (b->cond) {
+    bool success;
+    word_t value = expr_eval(&b->ex, &success);
+    if (!success || value == 0) return false;
+  }
+  if (MUXDEF(CONFIG_RR, rr_skip_stop(false), false)) return false;
+  b->hit ++;
+  printf("%s %d, ", (b->temp ? "Temporary breakpoint" : "Breakpoint"), b->NO);
+  print_location(pc);
+  printf("\n");
+  if (b->temp) {
+    IFDEF(CONFIG_RR, rr_journal("bd %d", b->NO));
+    free_bp(s->idx);
+  }
+  nemu_state.state = NEMU_STOP;
+  return true;
+}
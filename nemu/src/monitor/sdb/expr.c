@@ -14,50 +14,51 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <memory/vaddr.h>
+#include "sdb.h"
 
 /* We use the POSIX regex functions to process regular expressions.
  * Type 'man regex' for more information about POSIX regex functions.
  */
 #include <regex.h>
 
+// Expressions are tokenized with the regular expressions and parsed only
+// once by expr_compile(), into the bytecode of a stack machine. Constant
+// subexpressions are folded. expr_eval() then runs the bytecode in a
+// loop, which is cheap enough for watchpoints checked after every
+// instruction. Values are unsigned words, as the registers.
+
 enum {
   TK_NOTYPE = 256, TK_EQ,
-  TK_NUM, TK_NEG, TK_HEX, TK_REG, 
-  TK_NEQ, TK_DEREF, TK_AND, 
-  TK_BT, TK_LT, TK_BE, TK_LE,
-  TK_OR, TK_NOT,
-  /* TODO: Add more token types */
-
+  TK_NUM, TK_HEX, TK_REG,
+  TK_NEQ, TK_AND, TK_OR,
+  TK_GE, TK_LE,
 };
 
 static struct rule {
   const char *regex;
   int token_type;
 } rules[] = {
-
-  /* TODO: Add more rules.
-   * Pay attention to the precedence level of different rules.
-   */
-
-  {" +",          TK_NOTYPE   },               // spaces
-  {"\\+",         '+'         },               // plus
-  {"\\-",         '-'         },               // minus
-  {"\\*",         '*'         },               // times
-  {"\\/",         '/'         },               // divide
-  {"\\(",         '('         },               // left-parentheses
-  {"\\)",         ')'         },               // right-parentheses
-  {"[0][x]",      TK_HEX      },               // hexadecimal-number
-  {"[0-9A-F]+",   TK_NUM      },               // decimal-number
-  {"\\$",         TK_REG      },               // register
-  {"\\&&",        TK_AND      },               // AND
-  {"\\|\\|",      TK_OR       },               // OR
-  {"\\!",         TK_NOT      },               // NOT
-  {"==",          TK_EQ       },               // equal 
-  {"!=",          TK_NEQ      },               // not equal 
-  {"\\>=",        TK_BE       },               // bigger or equal
-  {"\\<=",        TK_LE       },               // less or equal
-  {"\\<",         TK_LT       },               // less than
-  {"\\>",         TK_BT       },               // bigger than
+  {" +",                  TK_NOTYPE   },      // spaces
+  {"0[xX][0-9a-fA-F]+",   TK_HEX      },      // hexadecimal number
+  {"[0-9]+",              TK_NUM      },      // decimal number
+  {"\\$[$a-zA-Z0-9]+",    TK_REG      },      // register
+  {"==",                  TK_EQ       },      // equal
+  {"!=",                  TK_NEQ      },      // not equal
+  {"&&",                  TK_AND      },      // logical and
+  {"\\|\\|",              TK_OR       },      // logical or
+  {">=",                  TK_GE       },      // greater or equal
+  {"<=",                  TK_LE       },      // less or equal
+  {"<",                   '<'         },      // less than
+  {">",                   '>'         },      // greater than
+  {"!",                   '!'         },      // not
+  {"\\+",                 '+'         },      // plus
+  {"-",                   '-'         },      // minus, or negation
+  {"\\*",                 '*'         },      // times, or dereference
+  {"/",                   '/'         },      // divide
+  {"%",                   '%'         },      // remainder
+  {"\\(",                 '('         },      // left parenthesis
+  {"\\)",                 ')'         },      // right parenthesis
 };
 
 #define NR_REGEX ARRLEN(rules)
@@ -86,10 +87,10 @@ typedef struct token {
   char str[32];
 } Token;
 
-static Token tokens[32] __attribute__((used)) = {};
-static int nr_token __attribute__((used))  = 0;
+static Token tokens[64] = {};
+static int nr_token = 0;
 
-static bool make_token(char *e) {
+static bool make_token(const char *e) {
   int position = 0;
   int i;
   regmatch_t pmatch;
@@ -100,50 +101,24 @@ static bool make_token(char *e) {
     /* Try all rules one by one. */
     for (i = 0; i < NR_REGEX; i ++) {
       if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-        char *substr_start = e + position;
+        const char *substr_start = e + position;
         int substr_len = pmatch.rm_eo;
 
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-
         position += substr_len;
+        if (rules[i].token_type == TK_NOTYPE) break;
 
-        /* TODO: Now a new token is recognized with rules[i]. Add codes
-         * to record the token in the array `tokens'. For certain types
-         * of tokens, some extra actions should be performed.
-         */
-
-        switch (rules[i].token_type) {
-          case '+':         tokens[nr_token].type = rules[i].token_type;
-          case '-':         tokens[nr_token].type = rules[i].token_type;
-          case '*':         tokens[nr_token].type = rules[i].token_type;
-          case '/':         tokens[nr_token].type = rules[i].token_type;
-          case '(':         tokens[nr_token].type = rules[i].token_type;
-          case ')':         tokens[nr_token].type = rules[i].token_type;
-          case TK_REG:      tokens[nr_token].type = rules[i].token_type;
-          case TK_EQ:       tokens[nr_token].type = rules[i].token_type;
-          case TK_NEQ:      tokens[nr_token].type = rules[i].token_type;
-          case TK_BE:       tokens[nr_token].type = rules[i].token_type;
-          case TK_BT:       tokens[nr_token].type = rules[i].token_type;
-          case TK_LE:       tokens[nr_token].type = rules[i].token_type;
-          case TK_LT:       tokens[nr_token].type = rules[i].token_type;
-          case TK_AND:      tokens[nr_token].type = rules[i].token_type;
-          case TK_OR:       tokens[nr_token].type = rules[i].token_type;
-          case TK_NOT:      tokens[nr_token].type = rules[i].token_type;
-          case TK_HEX: 
-                            tokens[nr_token].type = rules[i].token_type;
-                            strncpy(tokens[nr_token++].str, substr_start, substr_len);
-                            tokens[nr_token].str[substr_len] = '\0';
-                            break;
-          case TK_NUM:
-                            tokens[nr_token].type = rules[i].token_type;
-                            strncpy(tokens[nr_token++].str, substr_start, substr_len);
-                            tokens[nr_token].str[substr_len] = '\0';
-                            break;
-          case TK_NOTYPE:
-                            break;
+        if (nr_token == ARRLEN(tokens)) {
+          printf("too many tokens\n");
+          return false;
         }
-
+        if (substr_len >= sizeof(tokens[0].str)) {
+          printf("token too long at position %d\n", position - substr_len);
+          return false;
+        }
+        tokens[nr_token].type = rules[i].token_type;
+        memcpy(tokens[nr_token].str, substr_start, substr_len);
+        tokens[nr_token].str[substr_len] = '\0';
+        nr_token ++;
         break;
       }
     }
@@ -157,159 +132,218 @@ static bool make_token(char *e) {
   return true;
 }
 
-void check_unary(int p, int q){
-  for(int i = p; i <= q; i++){
-    if(tokens[i].type == '-'){ 
-      if(tokens[i].type == '-' && i == 0) tokens[i].type = TK_NEG;
-      else if(tokens[i].type == '-' && i != 0 && tokens[i-1].type != TK_NUM && tokens[i-1].type != ')') tokens[i].type = TK_NEG;
-    }
-    if(tokens[i].type == '*'){ 
-        if(tokens[i].type == '*' && i == 0) tokens[i].type = TK_DEREF;
-        else if(tokens[i].type == '*' && i != 0 && tokens[i-1].type != TK_NUM && tokens[i-1].type != ')') tokens[i].type = TK_DEREF;
-    }
-  }
+// ----------- compiler -----------
+
+enum {
+  OP_IMM, OP_REG, OP_PC,
+  OP_DEREF, OP_NEG, OP_NOT,
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_REM,
+  OP_EQ, OP_NEQ, OP_LT, OP_LE, OP_GT, OP_GE,
+  OP_AND_JMP, // pop if not zero, otherwise jump to `imm`
+  OP_OR_JMP,  // pop if zero, otherwise set to 1 and jump to `imm`
+  OP_BOOL,
+};
+
+#define EXPR_STACK 64
+
+static int pos = 0;       // the next token
+static Expr *cur = NULL;  // the expression being compiled
+static int cap = 0, depth = 0;
+static bool error = false;
+
+static void compile_error(const char *msg) {
+  if (!error) printf("%s at token %d\n", msg, pos);
+  error = true;
 }
 
-bool check_parentheses(int p, int q){
-  if(tokens[p].type == '(' && tokens[q].type == ')'){
-    int cnt = 0;
-    for(int i = p; i <= q; i++){
-      if(tokens[i].type == '(') cnt++;
-      else if(tokens[i].type == ')') cnt--;
-      if(cnt == 0) return i == q;
-    }
+static void emit(int op, word_t imm) {
+  if (cur->len == cap) {
+    cap = (cap == 0 ? 16 : cap * 2);
+    cur->code = realloc(cur->code, sizeof(cur->code[0]) * cap);
+    assert(cur->code);
   }
-  return false;
+  cur->code[cur->len ++] = (ExprInst) { .op = op, .imm = imm };
+  // track the depth of the stack
+  if (op == OP_IMM || op == OP_REG || op == OP_PC) depth ++;
+  else if (op >= OP_ADD && op <= OP_GE) depth --;
+  else if (op == OP_AND_JMP || op == OP_OR_JMP) depth --; // on the path to the right operand
+  if (depth > cur->max_depth) cur->max_depth = depth;
 }
 
-int find_major(int p, int q){
-  int cnt = 0, op_type = 0, position = -1;
-  for(int i = p; i <= q; i++){
-    // printf("In find major, start = %d, end = %d\n", p, q);
-    if(tokens[i].type == TK_NUM) continue;
-    if(tokens[i].type == '(') cnt++;
-    else if(tokens[i].type == ')'){
-      if (cnt == 0) return -1;
-      cnt--;
-    }
-    else if(cnt > 0) continue;
-    else{
-      int tmp_type = 0;
-      switch (tokens[i].type){
-        case TK_NEG:   tmp_type = 0; break;
-        case TK_DEREF: tmp_type = 0; break;
-        case TK_REG:   tmp_type = 0; break;
-        case TK_HEX:   tmp_type = 0; break;
-        case TK_NOT:   tmp_type = 0; break;
-        case TK_EQ:    tmp_type = 3; break;   
-        case TK_NEQ:   tmp_type = 3; break;
-        case TK_BE:    tmp_type = 3; break;
-        case TK_BT:    tmp_type = 3; break;
-        case TK_LE:    tmp_type = 3; break;
-        case TK_LT:    tmp_type = 3; break;
-        case TK_AND:   tmp_type = 3; break;
-        case TK_OR:    tmp_type = 3; break;
-        case '*':      tmp_type = 1; break;
-        case '/':      tmp_type = 1; break;
-        case '+':      tmp_type = 2; break;
-        case '-':      tmp_type = 2; break;
-        default: assert(0);
-      }
-      if(tmp_type >= op_type){
-        op_type = tmp_type;
-        position = i;
-      }
-    }
+static ExprInst *last(int i) { return (cur->len >= i ? &cur->code[cur->len - i] : NULL); }
+
+static bool binary(int op, word_t a, word_t b, word_t *res) {
+  switch (op) {
+    case OP_ADD: *res = a + b; break;
+    case OP_SUB: *res = a - b; break;
+    case OP_MUL: *res = a * b; break;
+    case OP_DIV: if (b == 0) return false; *res = a / b; break;
+    case OP_REM: if (b == 0) return false; *res = a % b; break;
+    case OP_EQ:  *res = (a == b); break;
+    case OP_NEQ: *res = (a != b); break;
+    case OP_LT:  *res = (a < b); break;
+    case OP_LE:  *res = (a <= b); break;
+    case OP_GT:  *res = (a > b); break;
+    case OP_GE:  *res = (a >= b); break;
+    default: panic("bad operator %d", op);
   }
-  if(cnt != 0) return -1;
-  return position;
+  return true;
 }
 
-int Hex_Conversion_Dec(int hex){    
-     int Dec = 0;                // 保存转换为10进制的结果
-     int k = 16;                 // 16进制
-     int n = 1;                  // 位权
-     while(hex != 0){
-         Dec += (hex % 10) * n;  // 取出各位位码值，并乘以对应的位权值
-         hex /= 10;              // 去掉16进制数的最低位，次低位变为最低位
-         n *= k;                 // 位权乘以16
-     }
-     return Dec;                 // 输出转换后的结果
+static void emit_unary(int op) {
+  ExprInst *a = last(1);
+  if (op == OP_DEREF) {
+    if (a->op == OP_IMM && cur->nr_addr < EXPR_MAX_ADDR) cur->addr[cur->nr_addr ++] = a->imm;
+    else cur->dep_mem_dynamic = true;
+  } else if (a->op == OP_IMM) {
+    a->imm = (op == OP_NEG ? -a->imm : !a->imm);
+    return;
+  }
+  emit(op, 0);
 }
 
-extern word_t vaddr_read(vaddr_t addr, int len);
-
-int eval(int p, int q){
-  //printf("start = %d, end = %d\n", p, q);
-  if (p > q){
-    printf("Bad Expression!.\n");
-    assert(0);
+static void emit_binary(int op) {
+  ExprInst *a = last(2), *b = last(1);
+  word_t res;
+  if (a->op == OP_IMM && b->op == OP_IMM && binary(op, a->imm, b->imm, &res)) {
+    a->imm = res;
+    cur->len --;
+    depth --;
+    return;
   }
-  else if(p == q){
-    if(tokens[p].type != TK_NUM){
-      printf("type = %d\n", tokens[p].type);
-      assert(0);
+  emit(op, 0);
+}
+
+static void parse_expr(int level);
+
+static void parse_primary() {
+  if (pos >= nr_token) { compile_error("unexpected end"); return; }
+  Token *t = &tokens[pos ++];
+  switch (t->type) {
+    case TK_NUM: emit(OP_IMM, strtoull(t->str, NULL, 10)); return;
+    case TK_HEX: emit(OP_IMM, strtoull(t->str, NULL, 16)); return;
+    case TK_REG: {
+      extern const char *regs[];
+      const char *name = t->str + 1;
+      if (strcmp(name, "pc") == 0) { cur->dep_pc = true; emit(OP_PC, 0); return; }
+      for (int i = 0; i < ARRLEN(cpu.gpr); i ++) {
+        const char *r = (regs[i][0] == '$' ? regs[i] + 1 : regs[i]);
+        if (strcmp(name, r) == 0) { cur->reg_mask |= 1ull << i; emit(OP_REG, i); return; }
       }
-    int num = 0;
-    if(tokens[p].type == TK_NUM){
-      num = strtol(tokens[p].str, NULL, 10);
+      compile_error("unknown register");
+      return;
     }
-    return num;
+    case '(':
+      parse_expr(0);
+      if (pos < nr_token && tokens[pos].type == ')') pos ++;
+      else compile_error("missing ')'");
+      return;
+    case '-': parse_primary(); if (!error) emit_unary(OP_NEG); return;
+    case '!': parse_primary(); if (!error) emit_unary(OP_NOT); return;
+    case '*': parse_primary(); if (!error) emit_unary(OP_DEREF); return;
+    default: pos --; compile_error("unexpected token");
   }
-  else if(check_parentheses(p, q) == true){
-    //printf("parentheses start = %d, parentheses end = %d\n", p, q);
-    return eval(p+1, q-1);
+}
+
+// binary operators by precedence, from low to high
+static const struct { int level, token, op; } binops[] = {
+  { 1, TK_OR, OP_OR_JMP }, { 2, TK_AND, OP_AND_JMP },
+  { 3, TK_EQ, OP_EQ }, { 3, TK_NEQ, OP_NEQ },
+  { 4, '<', OP_LT }, { 4, TK_LE, OP_LE }, { 4, '>', OP_GT }, { 4, TK_GE, OP_GE },
+  { 5, '+', OP_ADD }, { 5, '-', OP_SUB },
+  { 6, '*', OP_MUL }, { 6, '/', OP_DIV }, { 6, '%', OP_REM },
+};
+
+static int find_binop(int type) {
+  for (int i = 0; i < ARRLEN(binops); i ++) {
+    if (binops[i].token == type) return i;
   }
-  else{
-    int major = find_major(p, q);
-    //printf("check parentheses = %d\n", check_parentheses(p, q));
-    //printf("major = %d\n", major);
-    if(major < 0) assert(0);
-    int val1 = 0;
-    if(tokens[major].type != TK_NEG 
-    && tokens[major].type != TK_DEREF 
-    && tokens[major].type != TK_REG 
-    && tokens[major].type != TK_HEX
-    && tokens[major].type != TK_NOT) val1 = eval(p, major-1);
-    int val2 = eval(major+1, q);
-    //printf("val1 = %d, val2 = %d\n", val1, val2);
-
-    switch(tokens[major].type){
-      case '+':             return val1 + val2;
-      case '-':             return val1 - val2;
-      case '*':             return val1 * val2;
-      case '/':
-                            if(val2 == 0) assert(0);
-                            return val1 / val2;
-      case TK_NEG:          return val2 * -1;
-      case TK_REG:          return cpu.gpr[val2];
-      case TK_DEREF:        return vaddr_read(val2, 4);
-      case TK_HEX:          return Hex_Conversion_Dec(val2);
-      case TK_EQ:           return val1 == val2;
-      case TK_NEQ:          return val1 != val2;
-      case TK_BE:           return val1 >= val2;
-      case TK_BT:           return val1 > val2;
-      case TK_LE:           return val1 <= val2;
-      case TK_LT:           return val1 < val2;
-      case TK_NOT:          return !val2;
-      case TK_OR:           return val1 || val2;
-      case TK_AND:          return val1 && val2;
-      default: assert(0);
+  return -1;
+}
+
+// parse the operators with precedence higher than `level`
+static void parse_expr(int level) {
+  parse_primary();
+  while (!error && pos < nr_token) {
+    int k = find_binop(tokens[pos].type);
+    if (k < 0 || binops[k].level <= level) return;
+    pos ++;
+    int op = binops[k].op;
+    if (op == OP_AND_JMP || op == OP_OR_JMP) {
+      int jmp = cur->len;
+      emit(op, 0);
+      parse_expr(binops[k].level);
+      emit(OP_BOOL, 0);
+      cur->code[jmp].imm = cur->len;
+      continue;
     }
+    parse_expr(binops[k].level);
+    if (!error) emit_binary(op);
   }
+}
+
+bool expr_compile(const char *e, Expr *ex) {
+  memset(ex, 0, sizeof(*ex));
+  if (!make_token(e)) return false;
+  cur = ex;
+  pos = 0;
+  cap = 0;
+  depth = 0;
+  error = false;
+  parse_expr(0);
+  if (!error && pos != nr_token) compile_error("unexpected token");
+  if (!error && ex->max_depth > EXPR_STACK) compile_error("expression too deep");
+  cur = NULL;
+  if (error) expr_free(ex);
+  return !error;
+}
+
+void expr_free(Expr *ex) {
+  free(ex->code);
+  ex->code = NULL;
+  ex->len = 0;
+}
 
+word_t expr_eval(const Expr *ex, bool *success) {
+  word_t st[EXPR_STACK];
+  int sp = 0;
+  *success = true;
+  for (const ExprInst *i = ex->code, *end = ex->code + ex->len; i < end; i ++) {
+    switch (i->op) {
+      case OP_IMM:   st[sp ++] = i->imm; break;
+      case OP_REG:   st[sp ++] = cpu.gpr[i->imm]; break;
+      case OP_PC:    st[sp ++] = cpu.pc; break;
+      case OP_DEREF: st[sp - 1] = vaddr_read(st[sp - 1], sizeof(word_t)); break;
+      case OP_NEG:   st[sp - 1] = -st[sp - 1]; break;
+      case OP_NOT:   st[sp - 1] = !st[sp - 1]; break;
+      case OP_BOOL:  st[sp - 1] = !!st[sp - 1]; break;
+      case OP_AND_JMP:
+        if (st[sp - 1] == 0) i = ex->code + i->imm - 1;
+        else sp --;
+        break;
+      case OP_OR_JMP:
+        if (st[sp - 1] != 0) { st[sp - 1] = 1; i = ex->code + i->imm - 1; }
+        else sp --;
+        break;
+      default:
+        sp --;
+        if (!binary(i->op, st[sp - 1], st[sp], &st[sp - 1])) {
+          *success = false;
+          return 0;
+        }
+    }
+  }
+  return st[0];
 }
 
 word_t expr(char *e, bool *success) {
-  if (!make_token(e)) {
+  Expr ex;
+  if (!expr_compile(e, &ex)) {
     *success = false;
     return 0;
   }
-  //printf("token type = %d\n", tokens[0].type);
-  check_unary(0, nr_token-1);
-  //printf("token type = %d\n", tokens[0].type);
-  //printf("nr_token = %d\n", nr_token);
-  int num = eval(0, nr_token-1);
-  /* TODO: Insert codes to evaluate the expression. */
-  return num;
+  word_t val = expr_eval(&ex, success);
+  if (!*success) printf("division by zero\n");
+  expr_free(&ex);
+  return val;
 }
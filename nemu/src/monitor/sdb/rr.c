@@ -0,0 +1,310 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "sdb.h"
+
+// Reverse execution. A snapshot is a forked NEMU sleeping on a semaphore,
+// taken every CONFIG_RR_INTERVAL instructions. To go back, the nearest
+// snapshot forks a process which replays to the target instruction and
+// takes over sdb, then the current process exits. The inputs from the host
+// are logged and read back while replaying, so the replay is deterministic.
+// Breakpoint and watchpoint commands are kept in a journal, and a restored
+// process applies those issued after its snapshot.
+//
+// The first process stays as the reaper of all the others, and exits with
+// the status of the last active one.
+
+#define NR_SNAP CONFIG_RR_NR_SNAPSHOT
+#define LOG_SIZE ((size_t)CONFIG_RR_LOG_SIZE << 20)
+#define JOURNAL_SIZE (64 * 1024)
+
+typedef struct {
+  pid_t pid; // 0 if the slot is free
+  uint64_t nr_inst;
+  sem_t wake;
+} Snapshot;
+
+typedef struct {
+  pid_t active; // the process running sdb
+  sem_t done;   // posted by the restored process
+  Snapshot snap[NR_SNAP];
+  // the request to the woken snapshot
+  uint64_t target;
+  uint64_t log_end;
+  bool scan;
+  uint64_t scan_limit;
+  uint64_t home;
+  size_t journal_len;
+  char journal[JOURNAL_SIZE];
+} Control;
+
+static Control *ctl = NULL; // shared by all processes
+static uint8_t *input_log = NULL;
+static size_t log_pos = 0, log_end = 0; // inputs are read back while log_pos < log_end
+static size_t journal_pos = 0;
+static bool applying = false;
+static bool replaying = false;
+uint64_t g_rr_next = 0;
+extern uint64_t g_nr_guest_inst;
+extern bool check_bp(vaddr_t pc);
+
+// the request taken by the restored process
+static bool pending = false;
+static uint64_t target = 0, origin = 0, home = 0;
+// with `scan`, look for the last stop before `scan_limit`
+static bool scan = false;
+static uint64_t scan_limit = 0, last_stop = UINT64_MAX;
+
+static void drop_snapshot(Snapshot *s) {
+  kill(s->pid, SIGKILL);
+  waitpid(s->pid, NULL, 0); // reaped by the first process if not a child
+  s->pid = 0;
+}
+
+bool rr_replaying() {
+  return replaying;
+}
+
+bool rr_input_replayed() {
+  return log_pos < log_end;
+}
+
+void rr_input(void *buf, size_t len) {
+  if (input_log == NULL) return;
+  Assert(log_pos + len <= LOG_SIZE, "The log of host inputs is full, increase CONFIG_RR_LOG_SIZE");
+  if (log_pos < log_end) {
+    Assert(log_pos + len <= log_end, "The replay diverges at instruction %" PRIu64, g_nr_guest_inst);
+    memcpy(buf, input_log + log_pos, len);
+  } else {
+    if (log_pos == log_end && log_end != 0) {
+      // a new future, the snapshots after now are stale
+      for (int i = 0; i < NR_SNAP; i ++) {
+        Snapshot *s = &ctl->snap[i];
+        if (s->pid != 0 && s->nr_inst > g_nr_guest_inst) drop_snapshot(s);
+      }
+    }
+    memcpy(input_log + log_pos, buf, len);
+  }
+  log_pos += len;
+}
+
+void rr_journal(const char *fmt, ...) {
+  if (ctl == NULL || applying) return;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(ctl->journal + ctl->journal_len, JOURNAL_SIZE - ctl->journal_len, fmt, ap);
+  va_end(ap);
+  Assert(ctl->journal_len + n + 1 < JOURNAL_SIZE, "The journal of sdb commands is full");
+  ctl->journal_len += n + 1;
+  journal_pos = ctl->journal_len;
+}
+
+static void apply_journal() {
+  // the commands have been shown before
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  applying = true;
+  while (journal_pos < ctl->journal_len) {
+    char *line = strdup(ctl->journal + journal_pos);
+    journal_pos += strlen(line) + 1;
+    sdb_exec(line);
+    free(line);
+  }
+  applying = false;
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+}
+
+bool rr_skip_stop(bool in_inst) {
+  if (!replaying) return false;
+  uint64_t stop = g_nr_guest_inst + in_inst;
+  if (scan && stop < scan_limit) last_stop = stop;
+  return true;
+}
+
+// the newest snapshot at or before `nr_inst`, or strictly before
+static Snapshot *find_snapshot(uint64_t nr_inst, bool strict) {
+  Snapshot *ret = NULL;
+  for (int i = 0; i < NR_SNAP; i ++) {
+    Snapshot *s = &ctl->snap[i];
+    if (s->pid == 0 || s->nr_inst > nr_inst || (strict && s->nr_inst == nr_inst)) continue;
+    if (ret == NULL || s->nr_inst > ret->nr_inst) ret = s;
+  }
+  return ret;
+}
+
+static Snapshot *new_snapshot() {
+  Snapshot *oldest = NULL, *victim = NULL;
+  for (int i = 0; i < NR_SNAP; i ++) {
+    Snapshot *s = &ctl->snap[i];
+    if (s->pid == 0) return s;
+    if (oldest == NULL || s->nr_inst < oldest->nr_inst) { victim = oldest; oldest = s; }
+    else if (victim == NULL || s->nr_inst < victim->nr_inst) victim = s;
+  }
+  // keep the oldest one to be able to go back to the beginning
+  drop_snapshot(victim);
+  return victim;
+}
+
+// called between instructions, return true in the restored process
+bool rr_snapshot() {
+  g_rr_next = g_nr_guest_inst + CONFIG_RR_INTERVAL;
+  if (ctl == NULL) return false;
+  // replaying the same future
+  for (int i = 0; i < NR_SNAP; i ++) {
+    if (ctl->snap[i].pid != 0 && ctl->snap[i].nr_inst == g_nr_guest_inst) return false;
+  }
+
+  Snapshot *s = new_snapshot();
+  s->nr_inst = g_nr_guest_inst;
+  sem_init(&s->wake, 1, 0);
+  fflush(NULL);
+  pid_t pid = fork();
+  Assert(pid >= 0, "Can not fork a snapshot");
+  if (pid > 0) { s->pid = pid; return false; }
+
+  // the snapshot, until it is killed
+  signal(SIGINT, SIG_IGN);
+  while (true) {
+    while (sem_wait(&s->wake) != 0) assert(errno == EINTR);
+    pid_t mid = fork();
+    Assert(mid >= 0, "Can not fork from a snapshot");
+    if (mid == 0) {
+      // orphan the restored process to be reaped by the first process
+      if (fork() != 0) _exit(0);
+      break;
+    }
+    waitpid(mid, NULL, 0);
+  }
+
+  // the restored process
+  signal(SIGINT, SIG_DFL);
+  pending = true;
+  target = ctl->target;
+  log_end = ctl->log_end;
+  scan = ctl->scan;
+  scan_limit = ctl->scan_limit;
+  home = ctl->home;
+  origin = g_nr_guest_inst;
+  ctl->active = getpid();
+  sem_post(&ctl->done);
+  return true;
+}
+
+static void restore(Snapshot *s, uint64_t to, bool scan_to, uint64_t limit) {
+  ctl->target = to;
+  ctl->log_end = (log_pos > log_end ? log_pos : log_end);
+  ctl->scan = scan_to;
+  ctl->scan_limit = limit;
+  ctl->home = home;
+  fflush(NULL);
+  sem_post(&s->wake);
+  while (sem_wait(&ctl->done) != 0) assert(errno == EINTR);
+  _exit(0);
+}
+
+void rr_step_back(uint64_t n) {
+  uint64_t to = (n > g_nr_guest_inst ? 0 : g_nr_guest_inst - n);
+  Snapshot *s = find_snapshot(to, false);
+  if (s == NULL) {
+    printf("No snapshot at or before instruction %" PRIu64 "\n", to);
+    return;
+  }
+  home = g_nr_guest_inst;
+  restore(s, to, false, 0);
+}
+
+void rr_continue_back() {
+  Snapshot *s = find_snapshot(g_nr_guest_inst, true);
+  if (s == NULL) {
+    printf("No snapshot before instruction %" PRIu64 "\n", g_nr_guest_inst);
+    return;
+  }
+  home = g_nr_guest_inst;
+  restore(s, g_nr_guest_inst, true, g_nr_guest_inst);
+}
+
+// called by sdb before reading a command
+void rr_resume() {
+  if (!pending) return;
+  pending = false;
+  apply_journal();
+
+  replaying = true;
+  last_stop = UINT64_MAX;
+  // the breakpoint at the first instruction is not checked by cpu_exec()
+#ifdef CONFIG_BREAKPOINT
+  if (scan) check_bp(cpu.pc);
+#endif
+  if (target > g_nr_guest_inst) cpu_exec(target - g_nr_guest_inst);
+  replaying = false;
+
+  if (scan) {
+    if (last_stop != UINT64_MAX) restore(find_snapshot(last_stop, false), last_stop, false, 0);
+    // look in the previous interval, including a stop at its end
+    Snapshot *s = find_snapshot(origin, true);
+    if (s != NULL) restore(s, origin, true, origin + 1);
+    printf("No breakpoint or watchpoint is hit before instruction %" PRIu64 "\n", home);
+    restore(find_snapshot(home, false), home, false, 0);
+  }
+  printf("Instruction %" PRIu64 ", pc = " FMT_WORD "\n", g_nr_guest_inst, cpu.pc);
+}
+
+static void supervise() {
+  signal(SIGINT, SIG_IGN);
+  int status = 0;
+  while (true) {
+    pid_t pid = wait(&status);
+    if (pid == -1 && errno == EINTR) continue;
+    if (pid == -1 || pid == ctl->active) break;
+  }
+  for (int i = 0; i < NR_SNAP; i ++) {
+    if (ctl->snap[i].pid != 0) kill(ctl->snap[i].pid, SIGKILL);
+  }
+  while (wait(NULL) != -1 || errno == EINTR);
+  _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+}
+
+void init_rr() {
+  ctl = mmap(NULL, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  input_log = mmap(NULL, LOG_SIZE, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  Assert(ctl != MAP_FAILED && input_log != MAP_FAILED, "Can not map the memory for reverse execution");
+  sem_init(&ctl->done, 1, 0);
+  int ret = prctl(PR_SET_CHILD_SUBREAPER, 1);
+  assert(ret == 0);
+
+  fflush(NULL);
+  pid_t pid = fork();
+  Assert(pid >= 0, "Can not fork");
+  if (pid > 0) supervise();
+  ctl->active = getpid();
+  Log("Reverse execution is enabled, with a snapshot every %d instructions", CONFIG_RR_INTERVAL);
+}
@@ -56,10 +56,22 @@ static int cmd_q(char *args) {
 static int cmd_help(char *args);
 static int cmd_si(char *args);
 static int cmd_info(char *args);
+#ifdef CONFIG_RR
+static int cmd_rsi(char *args);
+static int cmd_rc(char *args);
+#endif
 static int cmd_x(char *args);
 static int cmd_p(char *args);
 static int cmd_w(char *args);
 static int cmd_d(char *args);
+#ifdef CONFIG_BREAKPOINT
+static int cmd_b(char *args);
+static int cmd_tb(char *args);
+static int cmd_bd(char *args);
+#endif
+#ifdef CONFIG_ITRACE
+static int cmd_trace(char *args);
+#endif
 
 static struct {
   const char *name;
@@ -70,11 +82,23 @@ static struct {
   { "c", "Continue the execution of the program",                     cmd_c       },
   { "q", "Exit NEMU",                                                 cmd_q       },
   { "si", "Control the CPU execution",                                cmd_si      },
-  { "info", "Print related information",                              cmd_info    },
+#ifdef CONFIG_RR
+  { "rsi", "Step back N instructions: rsi [N]",                       cmd_rsi     },
+  { "rc", "Continue back to the last breakpoint or watchpoint hit",   cmd_rc      },
+#endif
+  { "info", "Print related information: r, w, b, stat",              cmd_info    },
   { "x", "Scan Memory",                                               cmd_x       },
   { "p", "Calculate Expression",                                      cmd_p       },
   { "w", "New Watchpoint.",                                           cmd_w       },
   { "d", "Delete Watchpoint",                                         cmd_d       },
+#ifdef CONFIG_BREAKPOINT
+  { "b", "New Breakpoint: b ADDR|SYMBOL [if EXPR]",                   cmd_b       },
+  { "tb", "New Temporary Breakpoint: tb ADDR|SYMBOL [if EXPR]",       cmd_tb      },
+  { "bd", "Delete Breakpoint",                                        cmd_bd      },
+#endif
+#ifdef CONFIG_ITRACE
+  { "trace", "Browse the instruction trace: load [FILE], b [N], f [N], r", cmd_trace },
+#endif
 
   /* TODO: Add more commands */
 
@@ -106,13 +130,24 @@ static int cmd_help(char *args) {
 }
 
 extern void display_wp();
+extern void display_bp();
 
 static int cmd_info(char *args){
-  char type;
-  sscanf(args, "%s", &type);
-  
-  if(type == 'r') isa_reg_display();
-  if(type == 'w') display_wp();
+  char *type = strtok(NULL, " ");
+  if(type == NULL){
+    printf("No subcommand.\n");
+    return 0;
+  }
+
+  if(strcmp(type, "r") == 0) isa_reg_display();
+  else if(strcmp(type, "w") == 0) display_wp();
+#ifdef CONFIG_BREAKPOINT
+  else if(strcmp(type, "b") == 0) display_bp();
+#endif
+#ifdef CONFIG_ISTAT
+  else if(strcmp(type, "stat") == 0) istat_display();
+#endif
+  else printf("Unknown subcommand '%s'\n", type);
 
   return 0;
 }
@@ -127,8 +162,22 @@ static int cmd_si(char *args) {
   return 0;
 }
 
+#ifdef CONFIG_RR
+static int cmd_rsi(char *args) {
+  uint64_t num = 1;
+  if (args != NULL) sscanf(args, "%" SCNu64, &num);
+  if (num > 0) rr_step_back(num);
+  return 0;
+}
+
+static int cmd_rc(char *args) {
+  rr_continue_back();
+  return 0;
+}
+#endif
+
 extern word_t paddr_read(vaddr_t addr, int len);
-extern void set_wp(char *expr, int result);
+extern void set_wp(char *expr);
 extern void delete_wp(int NO);
 
 static int cmd_x(char *args){
@@ -146,79 +195,120 @@ static int cmd_x(char *args){
   return 0;
 }
 
-extern word_t expr(char *e, bool *success);
 static int cmd_p(char *args){
   if(args == NULL){
     printf("No expression!\n");
     return 0;
   }
   bool success = true;
-  int num = expr(args, &success);
-  printf("result = %d\n", num);
+  word_t num = expr(args, &success);
+  if (success) printf("result = " FMT_WORD " (%" PRIu64 ")\n", num, (uint64_t)num);
   return 0;
 }
 
 static int cmd_w(char* args) {
   if(!args){
     printf("No expression.\n");
-    assert(0);
+    return 0;
   }
-  bool success = true;
-  int result = expr(args, &success);
-  assert(success);
-  set_wp(args, result);
+  set_wp(args);
   return 0;
 }
 
 static int cmd_d(char *args){
   if(!args){
     printf("No watchpoint number.\n");
-    assert(0);
+    return 0;
   }
   int NO = strtol(args, NULL, 10);
   delete_wp(NO);
   return 0;
 }
 
-void sdb_set_batch_mode() {
-  is_batch_mode = true;
+#ifdef CONFIG_BREAKPOINT
+extern void set_bp(char *args, bool temp);
+extern void delete_bp(int NO);
+
+static int cmd_b(char *args) {
+  if(!args){
+    printf("No location.\n");
+    return 0;
+  }
+  set_bp(args, false);
+  return 0;
 }
 
-void sdb_mainloop() {
-  if (is_batch_mode) {
-    cmd_c(NULL);
-    return;
+static int cmd_tb(char *args) {
+  if(!args){
+    printf("No location.\n");
+    return 0;
   }
+  set_bp(args, true);
+  return 0;
+}
 
-  for (char *str; (str = rl_gets()) != NULL; ) {
-    char *str_end = str + strlen(str);
+static int cmd_bd(char *args) {
+  if(!args){
+    printf("No breakpoint number.\n");
+    return 0;
+  }
+  delete_bp(strtol(args, NULL, 10));
+  return 0;
+}
+#endif
 
-    /* extract the first token as the command */
-    char *cmd = strtok(str, " ");
-    if (cmd == NULL) { continue; }
+#ifdef CONFIG_ITRACE
+static int cmd_trace(char *args) {
+  extern int itrace_cmd(char *args);
+  return itrace_cmd(args);
+}
+#endif
 
-    /* treat the remaining string as the arguments,
-     * which may need further parsing
-     */
-    char *args = cmd + strlen(cmd) + 1;
-    if (args >= str_end) {
-      args = NULL;
-    }
+void sdb_set_batch_mode() {
+  is_batch_mode = true;
+}
+
+// run a command line, return -1 to exit
+int sdb_exec(char *str) {
+  char *str_end = str + strlen(str);
+
+  /* extract the first token as the command */
+  char *cmd = strtok(str, " ");
+  if (cmd == NULL) { return 0; }
+
+  /* treat the remaining string as the arguments,
+   * which may need further parsing
+   */
+  char *args = cmd + strlen(cmd) + 1;
+  if (args >= str_end) {
+    args = NULL;
+  }
 
 #ifdef CONFIG_DEVICE
-    extern void sdl_clear_event_queue();
-    sdl_clear_event_queue();
+  extern void sdl_clear_event_queue();
+  sdl_clear_event_queue();
 #endif
 
-    int i;
-    for (i = 0; i < NR_CMD; i ++) {
-      if (strcmp(cmd, cmd_table[i].name) == 0) {
-        if (cmd_table[i].handler(args) < 0) { return; }
-        break;
-      }
+  for (int i = 0; i < NR_CMD; i ++) {
+    if (strcmp(cmd, cmd_table[i].name) == 0) {
+      return cmd_table[i].handler(args);
     }
+  }
+
+  printf("Unknown command '%s'\n", cmd);
+  return 0;
+}
+
+void sdb_mainloop() {
+  if (is_batch_mode) {
+    cmd_c(NULL);
+    return;
+  }
 
-    if (i == NR_CMD) { printf("Unknown command '%s'\n", cmd); }
+  while (true) {
+    IFDEF(CONFIG_RR, rr_resume());
+    char *str = rl_gets();
+    if (str == NULL || sdb_exec(str) < 0) { return; }
   }
 }
 
@@ -20,4 +20,43 @@
 
 word_t expr(char *e, bool *success);
 
+// An expression compiled into bytecode for a stack machine, which is
+// evaluated without parsing again.
+typedef struct {
+  int op;
+  word_t imm;
+} ExprInst;
+
+#define EXPR_MAX_ADDR 4
+
+typedef struct {
+  ExprInst *code;
+  int len;
+  int max_depth;
+  // what the value depends on
+  uint64_t reg_mask;            // bit i for cpu.gpr[i]
+  bool dep_pc;
+  int nr_addr;                  // words at constant addresses
+  vaddr_t addr[EXPR_MAX_ADDR];
+  bool dep_mem_dynamic;         // memory at computed addresses
+} Expr;
+
+bool expr_compile(const char *e, Expr *ex);
+word_t expr_eval(const Expr *ex, bool *success);
+void expr_free(Expr *ex);
+
+bool symbol_addr(const char *name, vaddr_t *addr);
+const char *symbol_name(vaddr_t addr, word_t *off);
+
+int sdb_exec(char *str);
+
+// reverse execution
+void rr_step_back(uint64_t n);
+void rr_continue_back();
+void rr_resume();
+void rr_journal(const char *fmt, ...);
+// true if a breakpoint or watchpoint is hit while replaying, `in_inst` if
+// it is hit in the middle of an instruction, which stops after it
+bool rr_skip_stop(bool in_inst);
+
 #endif
@@ -0,0 +1,112 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <elf.h>
+#include "sdb.h"
+
+// Function and object symbols of the guest program, sorted by address.
+
+typedef struct {
+  vaddr_t addr;
+  word_t size;
+  char *name;
+} Symbol;
+
+static Symbol *sym = NULL;
+static int nr_sym = 0, max_sym = 0;
+
+static void add_symbol(const char *name, vaddr_t addr, word_t size) {
+  if (nr_sym == max_sym) {
+    max_sym = (max_sym == 0 ? 256 : max_sym * 2);
+    sym = realloc(sym, sizeof(Symbol) * max_sym);
+    assert(sym);
+  }
+  sym[nr_sym ++] = (Symbol) { .addr = addr, .size = size, .name = strdup(name) };
+}
+
+#define def_load_symtab(bits) \
+static void load_symtab##bits(const uint8_t *buf, size_t size) { \
+  const Elf##bits##_Ehdr *eh = (const void *)buf; \
+  Assert(eh->e_shoff + eh->e_shnum * sizeof(Elf##bits##_Shdr) <= size, "bad section headers"); \
+  const Elf##bits##_Shdr *sh = (const void *)(buf + eh->e_shoff); \
+  for (int i = 0; i < eh->e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    const Elf##bits##_Sym *s = (const void *)(buf + sh[i].sh_offset); \
+    const char *strtab = (const char *)(buf + sh[sh[i].sh_link].sh_offset); \
+    int n = sh[i].sh_size / sizeof(*s); \
+    for (int j = 0; j < n; j ++) { \
+      int type = ELF##bits##_ST_TYPE(s[j].st_info); \
+      if ((type == STT_FUNC || type == STT_OBJECT) && s[j].st_name != 0) { \
+        add_symbol(strtab + s[j].st_name, s[j].st_value, s[j].st_size); \
+      } \
+    } \
+  } \
+}
+
+def_load_symtab(32)
+def_load_symtab(64)
+
+static int symbol_cmp(const void *a, const void *b) {
+  vaddr_t x = ((const Symbol *)a)->addr, y = ((const Symbol *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+void init_elf(const char *file) {
+  if (file == NULL) return;
+  FILE *fp = fopen(file, "rb");
+  Assert(fp, "Can not open '%s'", file);
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  fseek(fp, 0, SEEK_SET);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Assert(size >= EI_NIDENT && memcmp(buf, ELFMAG, SELFMAG) == 0, "'%s' is not an ELF file", file);
+  if (buf[EI_CLASS] == ELFCLASS64) load_symtab64(buf, size);
+  else load_symtab32(buf, size);
+  free(buf);
+
+  qsort(sym, nr_sym, sizeof(Symbol), symbol_cmp);
+  Log("Read %d symbols from %s", nr_sym, file);
+}
+
+bool symbol_addr(const char *name, vaddr_t *addr) {
+  for (int i = 0; i < nr_sym; i ++) {
+    if (strcmp(sym[i].name, name) == 0) { *addr = sym[i].addr; return true; }
+  }
+  return false;
+}
+
+// the symbol containing `addr`, or NULL
+const char *symbol_name(vaddr_t addr, word_t *off) {
+  int l = 0, r = nr_sym;
+  while (l < r) {
+    int m = (l + r) / 2;
+    if (sym[m].addr <= addr) l = m + 1;
+    else r = m;
+  }
+  // look back a few symbols for aliases and symbols without size
+  for (int i = l - 1; i >= 0 && i >= l - 4; i --) {
+    if (addr < sym[i].addr + (sym[i].size == 0 ? 1 : sym[i].size)) {
+      *off = addr - sym[i].addr;
+      return sym[i].name;
+    }
+  }
+  return NULL;
+}
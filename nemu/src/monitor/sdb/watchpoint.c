@@ -13,6 +13,9 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#include <isa.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include "sdb.h"
 
 #define NR_WP 32
@@ -20,14 +23,16 @@
 typedef struct watchpoint {
   int NO;
   struct watchpoint *next;
-  int value;
-  char *expr;
-  /* TODO: Add more members if necessary */
 
+  char *expr; // NULL if free
+  Expr ex;
+  word_t value;
+  bool data; // only depends on constant addresses, checked on writes
 } WP;
 
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL;
+static int nr_poll = 0; // watchpoints checked after every instruction
 
 void init_wp_pool() {
   int i;
@@ -40,69 +45,140 @@ void init_wp_pool() {
   free_ = wp_pool;
 }
 
-WP *new_wp(){
-  if(!free_){
-    printf("No free watchpoints.\n");
-    assert(0);
+static WP* new_wp() {
+  if (free_ == NULL) return NULL;
+  WP *wp = free_;
+  free_ = free_->next;
+  wp->next = head;
+  head = wp;
+  return wp;
+}
+
+static void free_wp(WP *wp) {
+  WP **p = &head;
+  while (*p != wp) p = &(*p)->next;
+  *p = wp->next;
+  wp->next = free_;
+  free_ = wp;
+}
+
+// only pmem is written by stores and DMA which check data watchpoints,
+// device registers may change at any time
+static bool is_data_wp(const Expr *ex) {
+  if (ex->nr_addr == 0 || ex->reg_mask != 0 || ex->dep_pc || ex->dep_mem_dynamic) return false;
+  for (int i = 0; i < ex->nr_addr; i ++) {
+    if (!in_pmem(ex->addr[i]) || !in_pmem(ex->addr[i] + sizeof(word_t) - 1)) return false;
   }
-  WP* new = free_;
-  free_ = free_ -> next;
-  head = new;
-  return new;
+  return true;
 }
 
-void free_wp(WP *wp){
-  WP *flag = &wp_pool[0];
-  if(wp == head) head = NULL;
-  else{
-    while(flag && flag->next != head) flag = flag->next;
-    flag->next = wp->next;
+// register the addresses of data watchpoints with the memory
+static void update_watch() {
+  IFDEF(CONFIG_WATCHPOINT, vaddr_watch_reset());
+  nr_poll = 0;
+  for (WP *wp = head; wp != NULL; wp = wp->next) {
+    if (!wp->data) { nr_poll ++; continue; }
+#ifdef CONFIG_WATCHPOINT
+    for (int i = 0; i < wp->ex.nr_addr; i ++) vaddr_watch(wp->ex.addr[i], sizeof(word_t));
+#endif
   }
-  free_ = wp;
 }
 
-void set_wp(char *expr, int result){
-  WP* wp = new_wp();
-  wp->expr = strndup(expr, strlen(expr));
-  //wp->expr = expr
-  wp->value = result;
-  printf("Set watchpoint %d: %s\n", wp->NO, expr);
+// `in_inst` if called in the middle of the instruction at `pc`
+static void wp_update_value(WP *wp, vaddr_t pc, bool in_inst) {
+  bool success;
+  word_t value = expr_eval(&wp->ex, &success);
+  if (success && value != wp->value) {
+    if (!MUXDEF(CONFIG_RR, rr_skip_stop(in_inst), false)) {
+      printf("Watchpoint %d: %s, at pc = " FMT_WORD "\n", wp->NO, wp->expr, pc);
+      printf("Old value = " FMT_WORD "\n", wp->value);
+      printf("New value = " FMT_WORD "\n", value);
+      if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+    }
+    wp->value = value;
+  }
 }
 
-void delete_wp(int NO){
-  assert(NO < NR_WP);
-  WP* wp = &wp_pool[NO];
-  WP* bwp = &wp_pool[NO-1];
-  WP* pwp = &wp_pool[NO+1];
+void set_wp(char *e) {
+  Expr ex;
+  if (!expr_compile(e, &ex)) {
+    printf("Bad expression: %s\n", e);
+    return;
+  }
+  bool success;
+  word_t value = expr_eval(&ex, &success);
+  if (!success) {
+    printf("Can not evaluate: %s\n", e);
+    expr_free(&ex);
+    return;
+  }
+  WP *wp = new_wp();
+  if (wp == NULL) {
+    printf("No free watchpoints.\n");
+    expr_free(&ex);
+    return;
+  }
+  wp->expr = strdup(e);
+  wp->ex = ex;
+  wp->value = value;
+  wp->data = is_data_wp(&ex);
+  update_watch();
+  IFDEF(CONFIG_RR, rr_journal("w %s", e));
+  printf("%s %d: %s = " FMT_WORD "\n", (wp->data ? "Data watchpoint" : "Watchpoint"), wp->NO, e, value);
+}
+
+void delete_wp(int NO) {
+  if (NO < 0 || NO >= NR_WP || wp_pool[NO].expr == NULL) {
+    printf("No watchpoint %d.\n", NO);
+    return;
+  }
+  WP *wp = &wp_pool[NO];
   printf("Delete watchpoint %d: %s\n", wp->NO, wp->expr);
+  IFDEF(CONFIG_RR, rr_journal("d %d", NO));
   free_wp(wp);
+  update_watch();
+  free(wp->expr);
   wp->expr = NULL;
-  bwp->next = wp;
-  wp->next = pwp;
+  expr_free(&wp->ex);
 }
 
-void display_wp(){
-  WP* first = &wp_pool[0];
-  printf("%-8s%-8s\n", "Number", "Expression");
-  while(first){
-    printf("%-8d%-8s\n", first->NO, first->expr);
-    first = first->next;
+static void display_deps(const Expr *ex) {
+  extern const char *regs[];
+  for (int i = 0; i < ARRLEN(cpu.gpr); i ++) {
+    if (ex->reg_mask & (1ull << i)) printf(" %s", regs[i]);
   }
+  if (ex->dep_pc) printf(" pc");
+  for (int i = 0; i < ex->nr_addr; i ++) printf(" [" FMT_WORD "]", ex->addr[i]);
+  if (ex->dep_mem_dynamic) printf(" [*]");
 }
 
-void check_wp(){
-  WP* first = &wp_pool[0];
-  while(first != head + 1){
-    bool success;
-    int new = expr(first->expr, &success);
-    if(first->value != new){
-      printf("Watchpoint %d: %s\n", first->NO, first->expr);
-      printf("Old value = %d\n", first->value);
-      printf("New value = %d\n", new);
-      nemu_state.state = NEMU_STOP;
-    }
-    first = first->next;
+void display_wp() {
+  printf("%-8s%-8s%-12s%-24s%s\n", "Num", "Type", "Value", "Expression", "Depends on");
+  for (int i = 0; i < NR_WP; i ++) {
+    WP *wp = &wp_pool[i];
+    if (wp->expr == NULL) continue;
+    printf("%-8d%-8s" FMT_WORD "  %-24s", wp->NO, (wp->data ? "data" : "poll"), wp->value, wp->expr);
+    display_deps(&wp->ex);
+    printf("\n");
   }
 }
-/* TODO: Implement the functionality of watchpoint */
 
+// called after the instruction at `pc`
+void check_wp(vaddr_t pc) {
+  if (nr_poll == 0) return;
+  for (WP *wp = head; wp != NULL; wp = wp->next) {
+    if (!wp->data) wp_update_value(wp, pc, false);
+  }
+}
+
+// called after a write to [addr, addr + len) which may hit a data watchpoint,
+// `in_inst` if it is written by the current instruction rather than a device
+void check_data_wp(vaddr_t addr, int len, bool in_inst) {
+  for (WP *wp = head; wp != NULL; wp = wp->next) {
+    if (!wp->data) continue;
+    for (int i = 0; i < wp->ex.nr_addr; i ++) {
+      vaddr_t a = wp->ex.addr[i];
+      if (addr < a + sizeof(word_t) && a < addr + len) { wp_update_value(wp, cpu.pc, in_inst); break; }
+    }
+  }
+}
@@ -0,0 +1,164 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <ctrace-def.h>
+#include <zlib.h>
+#include <unistd.h>
+
+// Commit trace writer, see ctrace-def.h. Compare the traces with
+// tools/ctrace-cmp.
+
+#define CHUNK_INSTS CONFIG_CTRACE_CHUNK
+
+static FILE *fp = NULL;
+static uint8_t *raw = NULL, *comp = NULL;
+static uLong raw_cap = 0, comp_cap = 0;
+static uint8_t *raw_p = NULL;
+static CTraceState state = {};
+static CTraceRecord cur = {};
+static uint32_t nr_inst = 0;   // in the current chunk
+static uint64_t nr_total = 0;
+static CTraceIndex *chunk_index = NULL;
+static uint64_t nr_chunk = 0, index_cap = 0;
+
+static void put(const void *buf, size_t size) {
+  size_t ret = fwrite(buf, size, 1, fp);
+  Assert(ret == 1, "Can not write the commit trace");
+}
+
+static void flush_chunk() {
+  if (nr_inst == 0) return;
+  uLongf comp_size = comp_cap;
+  int ret = compress2(comp, &comp_size, raw, raw_p - raw, Z_BEST_SPEED);
+  Assert(ret == Z_OK, "compress2() fails with %d", ret);
+
+  if (nr_chunk == index_cap) {
+    index_cap = (index_cap == 0 ? 1024 : index_cap * 2);
+    chunk_index = realloc(chunk_index, sizeof(chunk_index[0]) * index_cap);
+    assert(chunk_index);
+  }
+  chunk_index[nr_chunk ++] = (CTraceIndex) { .offset = ftell(fp), .first_idx = nr_total - nr_inst };
+
+  CTraceChunk c = { .first_idx = nr_total - nr_inst, .nr_inst = nr_inst,
+    .raw_size = raw_p - raw, .comp_size = comp_size };
+  put(&c, sizeof(c));
+  put(comp, comp_size);
+
+  raw_p = raw;
+  nr_inst = 0;
+  memset(&state, 0, sizeof(state));
+}
+
+// also called when NEMU aborts, so that the trace up to there can be read
+void ctrace_close() {
+  // an abort while closing leaves the trace as it is
+  static bool closing = false;
+  if (fp == NULL || closing) return;
+  closing = true;
+  flush_chunk();
+  CTraceFooter f = { .index_offset = ftell(fp), .nr_chunk = nr_chunk, .nr_inst = nr_total };
+  memcpy(f.magic, CTRACE_MAGIC, sizeof(f.magic));
+  if (nr_chunk > 0) put(chunk_index, sizeof(chunk_index[0]) * nr_chunk);
+  put(&f, sizeof(f));
+  fclose(fp);
+  fp = NULL;
+  Log("Commit trace: %" PRIu64 " instructions in %" PRIu64 " chunks", nr_total, nr_chunk);
+}
+
+void init_ctrace(const char *file) {
+  if (file == NULL) return;
+  // read back by ctrace_rollback()
+  fp = fopen(file, MUXDEF(CONFIG_DIFFTEST_BATCH, "w+b", "wb"));
+  Assert(fp, "Can not open '%s'", file);
+
+  raw_cap = (uLong)CHUNK_INSTS * CTRACE_MAX_RECORD;
+  comp_cap = compressBound(raw_cap);
+  raw = malloc(raw_cap);
+  comp = malloc(comp_cap);
+  assert(raw && comp);
+  raw_p = raw;
+
+  CTraceHeader h = { .version = CTRACE_VERSION, .chunk_insts = CHUNK_INSTS };
+  memcpy(h.magic, CTRACE_MAGIC, sizeof(h.magic));
+  put(&h, sizeof(h));
+  atexit(ctrace_close);
+  Log("Commit trace is written to %s", file);
+}
+
+void ctrace_log_write(paddr_t addr, int len, word_t data) {
+  if (fp == NULL || cur.nr_write == CTRACE_MAX_WRITE) return;
+  int i = cur.nr_write ++;
+  cur.write[i].addr = addr;
+  cur.write[i].len = len;
+  cur.write[i].data = data & (~0ull >> (64 - 8 * len));
+}
+
+void ctrace_commit(vaddr_t pc, uint32_t inst) {
+  if (fp == NULL) return;
+  word_t data;
+  cur.pc = pc;
+  cur.inst = inst;
+  cur.rd = isa_difftest_commit(pc, &data);
+  cur.data = data;
+  raw_p = ctrace_encode(raw_p, &state, &cur);
+  cur.nr_write = 0;
+  nr_total ++;
+  if (++ nr_inst == CHUNK_INSTS) flush_chunk();
+}
+
+#ifdef CONFIG_DIFFTEST_BATCH
+// the checkpoint of batch difftest
+static struct {
+  uint64_t nr_total, nr_chunk;
+  uint32_t nr_inst;
+  size_t raw_size;
+  CTraceState state;
+} ck = {};
+
+void ctrace_checkpoint() {
+  if (fp == NULL) return;
+  ck.nr_total = nr_total;
+  ck.nr_chunk = nr_chunk;
+  ck.nr_inst = nr_inst;
+  ck.raw_size = raw_p - raw;
+  ck.state = state;
+}
+
+// Drop the records after the checkpoint, which are written again by the
+// replay. If the chunk of the checkpoint is flushed since, it is read
+// back from the file and reopened.
+void ctrace_rollback() {
+  if (fp == NULL) return;
+  if (nr_chunk > ck.nr_chunk) {
+    long off = chunk_index[ck.nr_chunk].offset;
+    bool ok = (fseek(fp, off, SEEK_SET) == 0);
+    if (ok && ck.nr_inst > 0) {
+      CTraceChunk c;
+      uLongf raw_size = raw_cap;
+      ok = fread(&c, sizeof(c), 1, fp) == 1 && fread(comp, c.comp_size, 1, fp) == 1 &&
+        uncompress(raw, &raw_size, comp, c.comp_size) == Z_OK;
+    }
+    ok = ok && fseek(fp, off, SEEK_SET) == 0 && ftruncate(fileno(fp), off) == 0;
+    Assert(ok, "Can not rewind the commit trace");
+    nr_chunk = ck.nr_chunk;
+  }
+  nr_total = ck.nr_total;
+  nr_inst = ck.nr_inst;
+  raw_p = raw + ck.raw_size;
+  state = ck.state;
+  cur.nr_write = 0;
+}
+#endif
@@ -18,3 +18,43 @@ CXXSRC = src/utils/disasm.cc
 CXXFLAGS += $(shell llvm-config --cxxflags) -fPIE
 LIBS += $(shell llvm-config --libs)
 endif
+
+ifndef CONFIG_ITRACE
+SRCS-BLACKLIST-y += src/utils/itrace.c
+endif
+
+ifdef CONFIG_CTRACE
+LIBS += -lz
+else
+SRCS-BLACKLIST-y += src/utils/ctrace.c
+endif
+
+ifndef CONFIG_FTRACE
+SRCS-BLACKLIST-y += src/utils/ftrace.c
+endif
+
+ifndef CONFIG_ISTAT
+SRCS-BLACKLIST-y += src/utils/istat.c
+endif
+
+ifndef CONFIG_PROF
+SRCS-BLACKLIST-y += src/utils/prof.c
+endif
+
+ifdef CONFIG_METRICS
+LIBS += -lpthread
+else
+SRCS-BLACKLIST-y += src/utils/metrics.c
+endif
+
+ifdef CONFIG_MEMEXPORT
+LIBS += -lpthread
+else
+SRCS-BLACKLIST-y += src/utils/memexport.c
+endif
+
+ifdef CONFIG_REPLAY
+LIBS += -lz
+else
+SRCS-BLACKLIST-y += src/utils/replay.c
+endif
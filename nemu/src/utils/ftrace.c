@@ -0,0 +1,277 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <ftrace-def.h>
+#include <unistd.h>
+
+// Function call tracer, see ftrace-def.h. The ISA reports calls and
+// returns. A shadow call stack counts the instructions of every function,
+// and the profile is written at exit together with the symbol names.
+// Print the trace with tools/ftrace-dump.
+
+#define NR_BUF 4096
+
+typedef struct {
+  vaddr_t addr;
+  uint64_t nr_call, inclusive, exclusive;
+  int depth; // active frames, so that recursion is counted once in `inclusive`
+} Func;
+
+typedef struct {
+  int func;
+  uint64_t entry;
+  uint64_t child; // instructions in the callees
+} Frame;
+
+extern uint64_t g_nr_guest_inst;
+extern const char *symbol_name(vaddr_t addr, word_t *off);
+
+static FILE *fp = NULL;
+static FTraceRecord buf[NR_BUF];
+static int nr_buf = 0;
+static uint64_t nr_record = 0;
+
+// the functions seen, indexed by an open-addressing hash table
+static Func *func = NULL;
+static int nr_func = 0, max_func = 0;
+static int *slot = NULL;
+static uint32_t slot_mask = 0;
+
+static Frame *stack = NULL;
+static int sp = 0, max_sp = 0;
+
+#ifdef CONFIG_DIFFTEST_BATCH
+// the frames pushed and popped since the checkpoint of batch difftest,
+// see ftrace_rollback()
+typedef struct {
+  bool pop;
+  Frame f;
+  uint64_t end;
+} Undo;
+
+static Undo *undo = NULL;
+static int nr_undo = 0, max_undo = 0;
+static uint64_t nr_record_checkpoint = 0;
+static int nr_func_checkpoint = 0;
+
+static void undo_log(bool pop, Frame f, uint64_t end) {
+  if (nr_undo == max_undo) {
+    max_undo = (max_undo == 0 ? 256 : max_undo * 2);
+    undo = realloc(undo, sizeof(Undo) * max_undo);
+    assert(undo);
+  }
+  undo[nr_undo ++] = (Undo) { .pop = pop, .f = f, .end = end };
+}
+#endif
+
+static inline uint32_t slot_hash(vaddr_t addr) {
+  return (uint32_t)(((uint64_t)addr * 0x9e3779b97f4a7c15ull) >> 32) & slot_mask;
+}
+
+static void slot_rebuild(uint32_t size) {
+  free(slot);
+  slot = malloc(sizeof(int) * size);
+  assert(slot);
+  memset(slot, -1, sizeof(int) * size);
+  slot_mask = size - 1;
+  for (int i = 0; i < nr_func; i ++) {
+    uint32_t h = slot_hash(func[i].addr);
+    while (slot[h] != -1) h = (h + 1) & slot_mask;
+    slot[h] = i;
+  }
+}
+
+static int func_idx(vaddr_t addr) {
+  uint32_t h = slot_hash(addr);
+  for (; slot[h] != -1; h = (h + 1) & slot_mask) {
+    if (func[slot[h]].addr == addr) return slot[h];
+  }
+  if (nr_func == max_func) {
+    max_func = (max_func == 0 ? 256 : max_func * 2);
+    func = realloc(func, sizeof(Func) * max_func);
+    assert(func);
+  }
+  func[nr_func] = (Func) { .addr = addr };
+  slot[h] = nr_func ++;
+  if (nr_func * 2 > (int)(slot_mask + 1)) slot_rebuild((slot_mask + 1) * 2);
+  return nr_func - 1;
+}
+
+static void push_frame(vaddr_t addr, uint64_t entry) {
+  if (sp == max_sp) {
+    max_sp = (max_sp == 0 ? 256 : max_sp * 2);
+    stack = realloc(stack, sizeof(Frame) * max_sp);
+    assert(stack);
+  }
+  int i = func_idx(addr);
+  func[i].nr_call ++;
+  func[i].depth ++;
+  stack[sp ++] = (Frame) { .func = i, .entry = entry };
+  IFDEF(CONFIG_DIFFTEST_BATCH, undo_log(false, stack[sp - 1], 0));
+}
+
+static void pop_frame(uint64_t end) {
+  Frame *f = &stack[-- sp];
+  IFDEF(CONFIG_DIFFTEST_BATCH, undo_log(true, *f, end));
+  Func *fn = &func[f->func];
+  uint64_t inclusive = end - f->entry;
+  fn->exclusive += inclusive - f->child;
+  if (-- fn->depth == 0) fn->inclusive += inclusive;
+  if (sp > 0) stack[sp - 1].child += inclusive;
+}
+
+static void put(const void *p, size_t size) {
+  if (size == 0) return;
+  size_t ret = fwrite(p, size, 1, fp);
+  Assert(ret == 1, "Can not write the function trace");
+}
+
+static void flush_buf() {
+  put(buf, sizeof(buf[0]) * nr_buf);
+  nr_buf = 0;
+}
+
+static void put_record(uint64_t time, vaddr_t pc, vaddr_t target) {
+  buf[nr_buf ++] = (FTraceRecord) { .time = time, .pc = pc, .target = target };
+  nr_record ++;
+  if (nr_buf == NR_BUF) flush_buf();
+}
+
+static int func_cmp(const void *a, const void *b) {
+  vaddr_t x = ((const Func *)a)->addr, y = ((const Func *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+// also called when NEMU aborts, so that the trace up to there can be read
+void ftrace_close() {
+  // an abort while closing leaves the trace as it is
+  static bool closing = false;
+  if (fp == NULL || closing) return;
+  closing = true;
+  flush_buf();
+  while (sp > 0) pop_frame(g_nr_guest_inst);
+  qsort(func, nr_func, sizeof(Func), func_cmp);
+
+  // symbolize the functions
+  char *names = NULL;
+  size_t name_size = 0;
+  FTraceFunc *f = malloc(sizeof(FTraceFunc) * (nr_func + 1));
+  assert(f);
+  for (int i = 0; i < nr_func; i ++) {
+    f[i] = (FTraceFunc) { .addr = func[i].addr, .nr_call = func[i].nr_call,
+      .inclusive = func[i].inclusive, .exclusive = func[i].exclusive, .name = FTRACE_NO_NAME };
+    word_t off;
+    const char *name = symbol_name(func[i].addr, &off);
+    if (name == NULL) continue;
+    char s[256];
+    if (off == 0) snprintf(s, sizeof(s), "%s", name);
+    else snprintf(s, sizeof(s), "%s+0x%" PRIx64, name, (uint64_t)off);
+    size_t len = strlen(s) + 1;
+    names = realloc(names, name_size + len);
+    assert(names);
+    memcpy(names + name_size, s, len);
+    f[i].name = name_size;
+    name_size += len;
+  }
+
+  FTraceFooter footer = { .nr_record = nr_record, .func_offset = ftell(fp),
+    .nr_func = nr_func, .name_size = name_size };
+  memcpy(footer.magic, FTRACE_MAGIC, sizeof(footer.magic));
+  put(f, sizeof(FTraceFunc) * nr_func);
+  put(names, name_size);
+  put(&footer, sizeof(footer));
+  fclose(fp);
+  fp = NULL;
+  free(f);
+  free(names);
+  Log("Function trace: %" PRIu64 " calls and returns of %d functions", nr_record, nr_func);
+}
+
+void init_ftrace(const char *file) {
+  if (file == NULL) return;
+  fp = fopen(file, "wb");
+  Assert(fp, "Can not open '%s'", file);
+
+  FTraceHeader h = { .version = FTRACE_VERSION, .word_size = sizeof(word_t) };
+  memcpy(h.magic, FTRACE_MAGIC, sizeof(h.magic));
+  put(&h, sizeof(h));
+  slot_rebuild(1024);
+  // the code before the first call
+  push_frame(cpu.pc, g_nr_guest_inst);
+  atexit(ftrace_close);
+  Log("Function trace is written to %s", file);
+}
+
+// the instruction at `pc` calls `target`
+void ftrace_call(vaddr_t pc, vaddr_t target) {
+  if (fp == NULL) return;
+  put_record(g_nr_guest_inst, pc, target);
+  // the call belongs to the caller
+  push_frame(target, g_nr_guest_inst + 1);
+}
+
+// the instruction at `pc` returns to `target`
+void ftrace_ret(vaddr_t pc, vaddr_t target) {
+  if (fp == NULL) return;
+  put_record(g_nr_guest_inst | FTRACE_RET, pc, target);
+  // the return belongs to the callee, and the first frame is never popped
+  if (sp > 1) pop_frame(g_nr_guest_inst + 1);
+}
+
+#ifdef CONFIG_DIFFTEST_BATCH
+void ftrace_checkpoint() {
+  nr_record_checkpoint = nr_record;
+  nr_func_checkpoint = nr_func;
+  nr_undo = 0;
+}
+
+// Undo the frames pushed and popped since the checkpoint, and drop the
+// records after it. They are traced again by the replay.
+void ftrace_rollback() {
+  if (fp == NULL) return;
+  while (nr_undo > 0) {
+    Undo *u = &undo[-- nr_undo];
+    if (!u->pop) {
+      sp --;
+      func[u->f.func].nr_call --;
+      func[u->f.func].depth --;
+      continue;
+    }
+    Func *fn = &func[u->f.func];
+    uint64_t inclusive = u->end - u->f.entry;
+    if (sp > 0) stack[sp - 1].child -= inclusive;
+    if (fn->depth ++ == 0) fn->inclusive -= inclusive;
+    fn->exclusive -= inclusive - u->f.child;
+    stack[sp ++] = u->f;
+  }
+  if (nr_func != nr_func_checkpoint) {
+    nr_func = nr_func_checkpoint;
+    slot_rebuild(slot_mask + 1);
+  }
+
+  uint64_t drop = nr_record - nr_record_checkpoint;
+  if (drop <= (uint64_t)nr_buf) nr_buf -= drop;
+  else {
+    // some of them are written to the file
+    long off = sizeof(FTraceHeader) + sizeof(FTraceRecord) * nr_record_checkpoint;
+    nr_buf = 0;
+    fflush(fp);
+    int ret = ftruncate(fileno(fp), off);
+    Assert(ret == 0 && fseek(fp, off, SEEK_SET) == 0, "Can not rewind the function trace");
+  }
+  nr_record = nr_record_checkpoint;
+}
+#endif
@@ -0,0 +1,62 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+
+// The instruction mix, from the counters of the patterns in INSTPAT.
+
+extern InstStat *__start_nemu_istat[], *__stop_nemu_istat[];
+
+static int istat_cmp(const void *a, const void *b) {
+  uint64_t x = (*(const InstStat **)a)->count, y = (*(const InstStat **)b)->count;
+  return (x < y) - (x > y);
+}
+
+static double percent(uint64_t x, uint64_t total) {
+  return (total == 0 ? 0 : 100.0 * x / total);
+}
+
+void istat_display() {
+  int n = __stop_nemu_istat - __start_nemu_istat;
+  const InstStat **s = malloc(sizeof(InstStat *) * n);
+  assert(s);
+  int nr = 0;
+  uint64_t total = 0;
+  uint64_t class_count[NR_INST_CLASS] = {}, class_taken[NR_INST_CLASS] = {};
+  for (InstStat **pp = __start_nemu_istat; pp < __stop_nemu_istat; pp ++) {
+    InstStat *p = *pp;
+    if (p->count == 0) continue;
+    s[nr ++] = p;
+    total += p->count;
+    int c = isa_inst_class(p->name);
+    class_count[c] += p->count;
+    class_taken[c] += p->taken;
+  }
+  qsort(s, nr, sizeof(s[0]), istat_cmp);
+
+  printf("%-10s %16s %8s %8s\n", "inst", "count", "%", "taken%");
+  for (int i = 0; i < nr; i ++) {
+    printf("%-10s %16" PRIu64 " %7.2f%%", s[i]->name, s[i]->count, percent(s[i]->count, total));
+    int c = isa_inst_class(s[i]->name);
+    if (c == INST_BRANCH || c == INST_JUMP) printf(" %7.2f%%", percent(s[i]->taken, s[i]->count));
+    printf("\n");
+  }
+  printf("total %" PRIu64 ": load %.2f%%, store %.2f%%, branch %.2f%% (%.2f%% taken), jump %.2f%%, other %.2f%%\n",
+      total, percent(class_count[INST_LOAD], total), percent(class_count[INST_STORE], total),
+      percent(class_count[INST_BRANCH], total), percent(class_taken[INST_BRANCH], class_count[INST_BRANCH]),
+      percent(class_count[INST_JUMP], total), percent(class_count[INST_OTHER], total));
+  free(s);
+}
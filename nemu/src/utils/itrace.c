@@ -1,39 +1,333 @@
-#include <common.h>
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
 
-#define MAX_SIZE 16
+#include <isa.h>
+
+// Instructions are traced as raw (pc, inst) pairs. They are only
+// disassembled when printed, and the text is cached, since the same
+// instructions are executed again and again.
+//
+// The ring of recently executed instructions also keeps the value of rd
+// after each of them. It is dumped to a file when NEMU fails, and the
+// `trace` command of sdb can load the dump and step through it with the
+// registers reconstructed.
+
+#define RING_SIZE CONFIG_ITRACE_RING
+#define RING_MASK (RING_SIZE - 1)
+#define NR_DISPLAY 16      // instructions shown by display_inst()
+#define LOG_BATCH 4096     // instructions written to the log at a time
+#define CACHE_SIZE 16384   // disassembled instructions
+
+static_assert((RING_SIZE & RING_MASK) == 0, "ITRACE_RING is not a power of 2");
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+extern const char *regs[];
 
 typedef struct {
-  word_t pc;
+  vaddr_t pc;
   uint32_t inst;
-} Iringbuf;
+} ITraceRecord;
+
+// structure of arrays, indexed by the number of instructions modulo RING_SIZE
+static vaddr_t ring_pc[RING_SIZE];
+static uint32_t ring_inst[RING_SIZE];
+static word_t ring_wb[RING_SIZE];
+static uint64_t nr_ring = 0;
+
+static ITraceRecord pending[LOG_BATCH];
+static int nr_pending = 0;
 
-Iringbuf Itracebuf[MAX_SIZE];
-int inst_pos = 0;
-bool full = false;
+static const char *dump_file = NULL;
 
-void trace_inst(word_t pc, uint32_t inst) {
-  Itracebuf[inst_pos].pc = pc;
-  Itracebuf[inst_pos].inst = inst;
-  inst_pos = (inst_pos + 1) % MAX_SIZE;
-  full = full || inst_pos == 0;
+// Direct-mapped, keyed by both pc and inst, since branch targets are
+// printed as absolute addresses.
+static struct {
+  vaddr_t pc;
+  uint32_t inst;
+  bool valid;
+  char str[64];
+} cache[CACHE_SIZE];
+
+static const char *disasm_cached(vaddr_t pc, uint32_t inst) {
+  uint32_t idx = ((pc >> 2) ^ (inst * 0x9e3779b1u)) % CACHE_SIZE;
+  if (!cache[idx].valid || cache[idx].pc != pc || cache[idx].inst != inst) {
+#ifndef CONFIG_ISA_loongarch32r
+    void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+    disassemble(cache[idx].str, sizeof(cache[idx].str), pc, (uint8_t *)&inst, sizeof(inst));
+#else
+    cache[idx].str[0] = '\0'; // the upstream llvm does not support loongarch32r
+#endif
+    cache[idx].pc = pc;
+    cache[idx].inst = inst;
+    cache[idx].valid = true;
+  }
+  return cache[idx].str;
 }
 
-void display_inst() {
-  if (!full && inst_pos == 0) return;
-  void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+// format as "pc: bytes disassembly"
+static void format_inst(char *buf, size_t size, vaddr_t pc, uint32_t inst) {
+  uint8_t *p = (uint8_t *)&inst;
+  snprintf(buf, size, FMT_WORD ": %02x %02x %02x %02x\t%s", pc, p[3], p[2], p[1], p[0],
+      disasm_cached(pc, inst));
+}
+
+void init_itrace(const char *file) {
+  dump_file = file;
+}
 
-  int end = inst_pos;
-  int i = full ? inst_pos : 0;
+void trace_inst(vaddr_t pc, uint32_t inst, word_t wb) {
+  uint64_t i = nr_ring ++ & RING_MASK;
+  ring_pc[i] = pc;
+  ring_inst[i] = inst;
+  ring_wb[i] = wb;
+}
+
+// for the rollback of batch difftest, see dut.c
+static uint64_t nr_ring_checkpoint = 0;
+
+void itrace_checkpoint() {
+  nr_ring_checkpoint = nr_ring;
+}
 
-  char buf[128]; 
-  char *p;
+// The records after the checkpoint are dropped, and written again by the
+// replay. The log is not rewound, where the replayed instructions follow
+// the message of the rollback.
+void itrace_rollback() {
+  nr_ring = nr_ring_checkpoint;
+}
+
+void itrace_flush() {
+  extern FILE* log_fp;
+  if (nr_pending == 0) return;
+  char buf[128];
+  for (int i = 0; i < nr_pending; i ++) {
+    format_inst(buf, sizeof(buf), pending[i].pc, pending[i].inst);
+    fprintf(log_fp, "%s\n", buf);
+  }
+  fflush(log_fp);
+  nr_pending = 0;
+}
+
+// write the instruction to the log, when the log is enabled
+void itrace_log(vaddr_t pc, uint32_t inst) {
+  extern bool log_enable();
+  if (!log_enable()) return;
+  pending[nr_pending].pc = pc;
+  pending[nr_pending].inst = inst;
+  if (++ nr_pending == LOG_BATCH) itrace_flush();
+}
+
+void itrace_print(vaddr_t pc, uint32_t inst) {
+  char buf[128];
+  format_inst(buf, sizeof(buf), pc, inst);
+  puts(buf);
+}
+
+void display_inst() {
+  if (nr_ring == 0) return;
+  uint64_t n = (nr_ring < NR_DISPLAY ? nr_ring : NR_DISPLAY);
+  char buf[128];
   printf("Recently Executed Instructions: \n");
-  do {
-    p = buf;
-    p += sprintf(buf, "-- 0x%x: %08x      ", Itracebuf[i].pc, Itracebuf[i].inst);
-    disassemble(p, sizeof(buf), Itracebuf[i].pc, (uint8_t *)&Itracebuf[i].inst, 4);
-    puts(buf);
-  } while ((i = (i + 1) % MAX_SIZE) != end);
+  for (uint64_t i = nr_ring - n; i < nr_ring; i ++) {
+    format_inst(buf, sizeof(buf), ring_pc[i & RING_MASK], ring_inst[i & RING_MASK]);
+    printf("%s %s\n", (i == nr_ring - 1 ? "-->" : "   "), buf);
+  }
+}
+
+// ----------- dump -----------
+
+// file := ITraceDumpHeader word_t gpr[nr_gpr] vaddr_t pc[nr_record]
+//         uint32_t inst[nr_record] word_t wb[nr_record]
+// The records are the last `nr_record` of `nr_inst` instructions executed,
+// the oldest first, and `gpr` is the state after them.
+
+#define ITRACE_MAGIC "NEMUITR1"
+
+typedef struct {
+  char magic[8];
+  uint32_t word_size;
+  uint32_t nr_gpr;
+  uint64_t nr_inst;
+  uint64_t nr_record;
+  uint64_t pc; // where NEMU stops
+} ITraceDumpHeader;
+
+static void put(const void *buf, size_t size, FILE *fp) {
+  if (size > 0 && fwrite(buf, size, 1, fp) != 1) printf("Can not write the instruction trace\n");
+}
+
+// write the oldest `n` records from `from` of the array `a`, which wraps
+#define put_ring(a, from, n, fp) do { \
+    uint64_t l = (from) & RING_MASK; \
+    uint64_t n1 = MIN((uint64_t)(n), RING_SIZE - l); \
+    put(&a[l], sizeof(a[0]) * n1, fp); \
+    put(&a[0], sizeof(a[0]) * ((n) - n1), fp); \
+  } while (0)
+
+// Called when NEMU fails, do not use Assert() here.
+void itrace_dump() {
+  static bool dumped = false;
+  if (dump_file == NULL || nr_ring == 0 || dumped) return;
+  dumped = true;
+  FILE *fp = fopen(dump_file, "wb");
+  if (fp == NULL) { printf("Can not open '%s'\n", dump_file); return; }
+  uint64_t n = MIN(nr_ring, (uint64_t)RING_SIZE);
+  uint64_t from = nr_ring - n;
+  ITraceDumpHeader h = { .word_size = sizeof(word_t), .nr_gpr = ARRLEN(cpu.gpr),
+    .nr_inst = nr_ring, .nr_record = n, .pc = cpu.pc };
+  memcpy(h.magic, ITRACE_MAGIC, sizeof(h.magic));
+  put(&h, sizeof(h), fp);
+  put(cpu.gpr, sizeof(cpu.gpr), fp);
+  put_ring(ring_pc, from, n, fp);
+  put_ring(ring_inst, from, n, fp);
+  put_ring(ring_wb, from, n, fp);
+  fclose(fp);
+  printf("The last %" PRIu64 " instructions are dumped to %s\n", n, dump_file);
+}
+
+// ----------- browsing in sdb -----------
+
+static struct {
+  ITraceDumpHeader h;
+  word_t *gpr;
+  vaddr_t *pc;
+  uint32_t *inst;
+  word_t *wb;
+  uint64_t cur; // the state before record `cur`, nr_record for the end
+} hist = {};
+
+static void hist_free() {
+  free(hist.gpr); free(hist.pc); free(hist.inst); free(hist.wb);
+  memset(&hist, 0, sizeof(hist));
+}
+
+static void hist_alloc(uint64_t n, int nr_gpr) {
+  hist.gpr = malloc(sizeof(word_t) * nr_gpr);
+  hist.pc = malloc(sizeof(vaddr_t) * n);
+  hist.inst = malloc(sizeof(uint32_t) * n);
+  hist.wb = malloc(sizeof(word_t) * n);
+  assert(hist.gpr && hist.pc && hist.inst && hist.wb);
+}
+
+static bool hist_load(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) { printf("Can not open '%s'\n", file); return false; }
+  ITraceDumpHeader h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, ITRACE_MAGIC, sizeof(h.magic)) ||
+      h.word_size != sizeof(word_t) || h.nr_gpr != ARRLEN(cpu.gpr)) {
+    printf("'%s' is not an instruction trace of this NEMU\n", file);
+    fclose(fp);
+    return false;
+  }
+  uint64_t n = h.nr_record;
+  hist_alloc(n, h.nr_gpr);
+  hist.h = h;
+  bool ok = fread(hist.gpr, sizeof(word_t) * h.nr_gpr, 1, fp) == 1 &&
+    (n == 0 || (fread(hist.pc, sizeof(vaddr_t) * n, 1, fp) == 1 &&
+                fread(hist.inst, sizeof(uint32_t) * n, 1, fp) == 1 &&
+                fread(hist.wb, sizeof(word_t) * n, 1, fp) == 1));
+  fclose(fp);
+  if (!ok) { printf("'%s' is truncated\n", file); hist_free(); }
+  return ok;
+}
+
+// take the ring of the running NEMU
+static void hist_snapshot() {
+  uint64_t n = MIN(nr_ring, (uint64_t)RING_SIZE);
+  hist_alloc(n, ARRLEN(cpu.gpr));
+  hist.h = (ITraceDumpHeader) { .word_size = sizeof(word_t), .nr_gpr = ARRLEN(cpu.gpr),
+    .nr_inst = nr_ring, .nr_record = n, .pc = cpu.pc };
+  memcpy(hist.gpr, cpu.gpr, sizeof(cpu.gpr));
+  for (uint64_t i = 0; i < n; i ++) {
+    uint64_t k = (nr_ring - n + i) & RING_MASK;
+    hist.pc[i] = ring_pc[k];
+    hist.inst[i] = ring_inst[k];
+    hist.wb[i] = ring_wb[k];
+  }
+}
+
+static void hist_show() {
+  uint64_t n = hist.h.nr_record;
+  uint64_t idx = hist.h.nr_inst - n + hist.cur; // in all executed instructions
+  if (hist.cur == n) {
+    printf("[%" PRIu64 "] end of the trace, pc = " FMT_WORD "\n", idx, (word_t)hist.h.pc);
+    return;
+  }
+  char buf[128];
+  format_inst(buf, sizeof(buf), hist.pc[hist.cur], hist.inst[hist.cur]);
+  int rd = isa_inst_rd(hist.inst[hist.cur]);
+  printf("[%" PRIu64 "] %s", idx, buf);
+  if (rd != 0) printf("\t# %s <- " FMT_WORD, regs[rd], hist.wb[hist.cur]);
+  printf("\n");
+}
+
+// registers before record `cur`, with the last writes before it, or the
+// final values if they are not written after it
+static void hist_regs() {
+  int nr_gpr = hist.h.nr_gpr;
+  bool known[nr_gpr], written_after[nr_gpr];
+  word_t val[nr_gpr];
+  for (int r = 0; r < nr_gpr; r ++) { known[r] = false; written_after[r] = false; }
+  for (uint64_t i = hist.cur; i < hist.h.nr_record; i ++) {
+    int rd = isa_inst_rd(hist.inst[i]);
+    if (rd < nr_gpr) written_after[rd] = true;
+  }
+  int nr_known = 0;
+  for (int r = 0; r < nr_gpr; r ++) {
+    if (!written_after[r]) { val[r] = hist.gpr[r]; known[r] = true; nr_known ++; }
+  }
+  for (uint64_t i = hist.cur; i > 0 && nr_known < nr_gpr; i --) {
+    int rd = isa_inst_rd(hist.inst[i - 1]);
+    if (rd < nr_gpr && !known[rd]) { val[rd] = hist.wb[i - 1]; known[rd] = true; nr_known ++; }
+  }
+  for (int r = 0; r < nr_gpr; r ++) {
+    if (r == 0) { val[r] = 0; known[r] = true; }
+    if (known[r]) printf("%-4s " FMT_WORD "%s", regs[r], val[r], (r % 4 == 3 ? "\n" : "  "));
+    else printf("%-4s %-*s%s", regs[r], (int)sizeof(word_t) * 2 + 2, "?", (r % 4 == 3 ? "\n" : "  "));
+  }
+  if (nr_gpr % 4 != 0) printf("\n");
+}
+
+// trace load [FILE] | trace b [N] | trace f [N] | trace r
+int itrace_cmd(char *args) {
+  char *sub = strtok(args, " ");
+  char *arg = strtok(NULL, " ");
+  if (sub == NULL) sub = "b";
+  if (strcmp(sub, "load") == 0) {
+    hist_free();
+    if (arg != NULL) { if (!hist_load(arg)) return 0; }
+    else hist_snapshot();
+    hist.cur = hist.h.nr_record;
+    printf("%" PRIu64 " of %" PRIu64 " instructions are loaded\n", hist.h.nr_record, hist.h.nr_inst);
+    return 0;
+  }
+  if (hist.pc == NULL) { printf("Load a trace with 'trace load [FILE]' first\n"); return 0; }
+  uint64_t n = (arg != NULL ? strtoull(arg, NULL, 0) : 1);
+  if (strcmp(sub, "b") == 0) {
+    hist.cur = (hist.cur > n ? hist.cur - n : 0);
+    hist_show();
+  } else if (strcmp(sub, "f") == 0) {
+    hist.cur = MIN(hist.cur + n, hist.h.nr_record);
+    hist_show();
+  } else if (strcmp(sub, "r") == 0) {
+    hist_regs();
+  } else {
+    printf("Unknown subcommand '%s'\n", sub);
+  }
+  return 0;
 }
 
 void addread(paddr_t addr, int len) {
@@ -0,0 +1,116 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <device/map.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Export the guest memory. Every connection to a Unix domain socket
+// receives the memfds backing pmem and the device space, followed by the
+// layout as `name fd addr size offset` lines, where `fd` is the index of
+// the descriptor and `offset` is where the region starts in it. The memfds
+// are sealed against writes except through the mapping of NEMU, so the
+// peer can not write the guest memory, but can read it in place.
+// Try tools/mem-peek.
+
+enum { FD_PMEM, FD_IO, NR_FD };
+
+static int fds[NR_FD] = { -1, -1 };
+static int nr_fd = 0;
+static char *sock_path = NULL;
+
+static int layout(char *buf, int size) {
+  int n = snprintf(buf, size, "pmem %d " FMT_PADDR " 0x%x 0x0\n", FD_PMEM, (paddr_t)CONFIG_MBASE, CONFIG_MSIZE);
+#ifdef CONFIG_DEVICE
+  int nr_map;
+  IOMap *maps = fetch_mmio_maps(&nr_map);
+  for (int i = 0; i < nr_map && n < size; i ++) {
+    n += snprintf(buf + n, size - n, "%s %d " FMT_PADDR " 0x%x 0x%x\n", maps[i].name, FD_IO,
+        maps[i].low, maps[i].high - maps[i].low + 1, io_space_offset(maps[i].space));
+  }
+#endif
+  return (n < size ? n : size - 1);
+}
+
+static void reply(int fd) {
+  char buf[4096];
+  int n = layout(buf, sizeof(buf));
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } ctl = {};
+  struct iovec iov = { .iov_base = buf, .iov_len = n };
+  struct msghdr msg = {
+    .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = ctl.buf, .msg_controllen = CMSG_SPACE(sizeof(int) * nr_fd),
+  };
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(int) * nr_fd);
+  memcpy(CMSG_DATA(c), fds, sizeof(int) * nr_fd);
+  // the descriptors are sent with the first bytes, the rest is the layout
+  ssize_t ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  for (int off = (ret > 0 ? ret : n); off < n; ) {
+    ret = send(fd, buf + off, n - off, MSG_NOSIGNAL);
+    if (ret <= 0) return;
+    off += ret;
+  }
+}
+
+static void *server(void *arg) {
+  int sock = (intptr_t)arg;
+  while (true) {
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) continue;
+    reply(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void close_memexport() {
+  unlink(sock_path);
+}
+
+void init_memexport(const char *path) {
+  if (path == NULL) return;
+  fds[nr_fd ++] = pmem_memfd();
+  IFDEF(CONFIG_DEVICE, fds[nr_fd ++] = io_space_memfd());
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  Assert(sock >= 0, "Can not create the socket to export the guest memory");
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  Assert(strlen(path) < sizeof(addr.sun_path), "The path of the socket to export the guest memory is too long");
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int ret = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+  Assert(ret == 0, "Can not bind the socket to export the guest memory to '%s'", path);
+  ret = listen(sock, 4);
+  assert(ret == 0);
+  sock_path = strdup(path);
+  atexit(close_memexport);
+
+  pthread_t thread;
+  ret = pthread_create(&thread, NULL, server, (void *)(intptr_t)sock);
+  assert(ret == 0);
+  pthread_detach(thread);
+  Log("Guest memory is exported at %s", path);
+}
@@ -0,0 +1,160 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/difftest.h>
+#include <device/event.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+// Live metrics. The CPU loop publishes a snapshot of its counters with a
+// sequence lock, and a server thread answers every connection to a Unix
+// domain socket with the last snapshot as `key value` lines. The CPU loop
+// never waits for the server. Watch them with tools/metrics-top.
+
+#define MAX_EVENT 16
+
+typedef struct {
+  uint64_t nr_inst;
+  uint64_t host_us;
+  double mips;      // since the last snapshot
+  vaddr_t pc;
+  int state;
+  uint64_t difftest_lag;
+  int nr_event;
+  struct {
+    const char *name;
+    uint64_t count;
+  } event[MAX_EVENT];
+} Metrics;
+
+uint64_t g_metrics_next = UINT64_MAX;
+extern uint64_t g_nr_guest_inst;
+
+// odd while the snapshot is being written
+static _Atomic uint32_t seq = 0;
+static Metrics snapshot = {};
+static char *sock_path = NULL;
+
+void metrics_publish() {
+  static uint64_t last_inst = 0, last_us = 0;
+  Metrics m = {};
+  m.nr_inst = g_nr_guest_inst;
+  m.host_us = get_time();
+  m.mips = (m.host_us == last_us ? 0 : (double)(m.nr_inst - last_inst) / (m.host_us - last_us));
+  m.pc = cpu.pc;
+  m.state = nemu_state.state;
+  m.difftest_lag = difftest_lag();
+  IFDEF(CONFIG_DEVICE, while (m.nr_event < MAX_EVENT && event_stat(m.nr_event,
+        &m.event[m.nr_event].name, &m.event[m.nr_event].count)) m.nr_event ++);
+  last_inst = m.nr_inst;
+  last_us = m.host_us;
+
+  uint32_t s = atomic_load_explicit(&seq, memory_order_relaxed);
+  atomic_store_explicit(&seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  snapshot = m;
+  atomic_store_explicit(&seq, s + 2, memory_order_release);
+  g_metrics_next = g_nr_guest_inst + CONFIG_METRICS_INTERVAL;
+}
+
+static void read_snapshot(Metrics *m) {
+  while (true) {
+    uint32_t s = atomic_load_explicit(&seq, memory_order_acquire);
+    if (s & 1) { sched_yield(); continue; }
+    *m = snapshot;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&seq, memory_order_relaxed) == s) return;
+  }
+}
+
+static void reply(int fd) {
+  static const char *state_name[] = {
+    [NEMU_RUNNING] = "running", [NEMU_STOP] = "stop", [NEMU_END] = "end",
+    [NEMU_ABORT] = "abort", [NEMU_QUIT] = "quit",
+  };
+  // the request is not used, the snapshot is sent anyway
+  char req[64];
+  if (read(fd, req, sizeof(req)) < 0) return;
+
+  Metrics m;
+  read_snapshot(&m);
+  char buf[4096];
+  int n = snprintf(buf, sizeof(buf),
+      "instructions %" PRIu64 "\n"
+      "host_time_us %" PRIu64 "\n"
+      "mips %.3f\n"
+      "pc " FMT_WORD "\n"
+      "state %s\n",
+      m.nr_inst, m.host_us, m.mips, m.pc, state_name[m.state]);
+#ifdef CONFIG_DIFFTEST
+  n += snprintf(buf + n, sizeof(buf) - n, "difftest_lag %" PRIu64 "\n", m.difftest_lag);
+#endif
+  for (int i = 0; i < m.nr_event; i ++) {
+    n += snprintf(buf + n, sizeof(buf) - n, "event.%s %" PRIu64 "\n", m.event[i].name, m.event[i].count);
+  }
+  for (int off = 0; off < n; ) {
+    ssize_t ret = send(fd, buf + off, n - off, MSG_NOSIGNAL);
+    if (ret <= 0) return;
+    off += ret;
+  }
+}
+
+static void *server(void *arg) {
+  int sock = (intptr_t)arg;
+  while (true) {
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) continue;
+    // a client which never sends its request must not hold up the others
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    reply(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void close_metrics() {
+  unlink(sock_path);
+}
+
+void init_metrics(const char *path) {
+  if (path == NULL) return;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  Assert(sock >= 0, "Can not create the metrics socket");
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  Assert(strlen(path) < sizeof(addr.sun_path), "The path of the metrics socket is too long");
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int ret = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+  Assert(ret == 0, "Can not bind the metrics socket to '%s'", path);
+  ret = listen(sock, 4);
+  assert(ret == 0);
+  sock_path = strdup(path);
+  atexit(close_metrics);
+
+  metrics_publish();
+  pthread_t thread;
+  ret = pthread_create(&thread, NULL, server, (void *)(intptr_t)sock);
+  assert(ret == 0);
+  pthread_detach(thread);
+  Log("Metrics are served at %s", path);
+}
@@ -0,0 +1,141 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <signal.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Phase profiler. The emulation loop only records the phase it is in;
+// a timer samples it, and the host cycles since the last sample are given
+// to the phase sampled. This does not slow down the phases themselves as
+// timing every call would.
+
+#define SAMPLE_US 100
+#define MAX_NAME 32
+
+volatile int g_phase = PHASE_MONITOR;
+const char * volatile g_phase_name = NULL;
+
+typedef struct {
+  uint64_t cycles;
+  uint64_t samples;
+} Sample;
+
+static Sample phase[NR_PHASE] = {};
+static struct {
+  int phase;
+  const char *name;
+  Sample s;
+} named[MAX_NAME] = {};
+static int nr_named = 0;
+static uint64_t last = 0;
+
+static const char *phase_name[NR_PHASE] = {
+  [PHASE_MONITOR] = "monitor",
+  [PHASE_FETCH]   = "fetch",
+  [PHASE_DECODE]  = "decode",
+  [PHASE_EXEC]    = "execute",
+  [PHASE_TRACE]   = "trace and difftest",
+  [PHASE_WATCH]   = "watchpoints",
+  [PHASE_LOOP]    = "loop",
+  [PHASE_INTR]    = "interrupts",
+  [PHASE_EVENT]   = "events",
+  [PHASE_IO]      = "device callbacks",
+};
+
+static inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static void sample(int sig) {
+  uint64_t now = read_cycles();
+  uint64_t delta = now - last;
+  last = now;
+  int p = g_phase;
+  if (p == PHASE_MONITOR) return;
+  phase[p].cycles += delta;
+  phase[p].samples ++;
+  if (p != PHASE_EVENT && p != PHASE_IO) return;
+
+  const char *name = g_phase_name;
+  int i;
+  for (i = 0; i < nr_named; i ++) {
+    if (named[i].phase == p && named[i].name == name) break;
+  }
+  if (i == nr_named) {
+    if (nr_named == MAX_NAME) return;
+    named[nr_named ++] = (typeof(named[0])) { .phase = p, .name = name };
+  }
+  named[i].s.cycles += delta;
+  named[i].s.samples ++;
+}
+
+void init_prof() {
+  struct sigaction sa = {};
+  sa.sa_handler = sample;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  int ret = sigaction(SIGPROF, &sa, NULL);
+  Assert(ret == 0, "Can not set the handler of SIGPROF");
+
+  // the high-resolution clock, as the process CPU-time clocks only fire at
+  // kernel ticks
+  timer_t timer;
+  struct sigevent sev = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGPROF };
+  ret = timer_create(CLOCK_MONOTONIC, &sev, &timer);
+  Assert(ret == 0, "Can not create the sampling timer");
+  last = read_cycles();
+  struct itimerspec it = { .it_interval = { 0, SAMPLE_US * 1000 }, .it_value = { 0, SAMPLE_US * 1000 } };
+  ret = timer_settime(timer, 0, &it, NULL);
+  Assert(ret == 0, "Can not start the sampling timer");
+  Log("Phase profiler: sampling every %d us", SAMPLE_US);
+}
+
+static void print_row(const char *name, const Sample *s, uint64_t total) {
+  printf("  %-30s %10" PRIu64 " %7.2f%%\n", name, s->samples, (total == 0 ? 0 : 100.0 * s->cycles / total));
+}
+
+void prof_display() {
+  // stop sampling while reading the results
+  sigset_t set, old;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPROF);
+  sigprocmask(SIG_BLOCK, &set, &old);
+
+  uint64_t total = 0;
+  for (int p = 0; p < NR_PHASE; p ++) total += phase[p].cycles;
+  printf("  %-30s %10s %8s\n", "phase", "samples", "time");
+  for (int p = 0; p < NR_PHASE; p ++) {
+    if (phase[p].samples == 0) continue;
+    print_row(phase_name[p], &phase[p], total);
+    for (int i = 0; i < nr_named; i ++) {
+      if (named[i].phase != p) continue;
+      char buf[64];
+      snprintf(buf, sizeof(buf), "  %s", (named[i].name ? named[i].name : "(queue)"));
+      print_row(buf, &named[i].s, total);
+    }
+  }
+
+  sigprocmask(SIG_SETMASK, &old, NULL);
+}
@@ -0,0 +1,108 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <zlib.h>
+
+// Record the inputs from the host with the instruction counts when the
+// guest takes them, and feed them back in the same order at the same
+// instruction counts. Each record is the number of instructions since the
+// previous record as an LEB128 number followed by the value, and the file
+// is compressed with zlib.
+
+#define REPLAY_MAGIC "NEMURPL1"
+
+static gzFile fp = NULL;
+static bool replaying = false;
+static uint64_t last_inst = 0;
+extern uint64_t g_nr_guest_inst;
+
+bool replay_active() {
+  return replaying;
+}
+
+static void put_leb128(uint64_t x) {
+  uint8_t buf[10];
+  int n = 0;
+  do {
+    buf[n] = x & 0x7f;
+    x >>= 7;
+    if (x != 0) buf[n] |= 0x80;
+    n ++;
+  } while (x != 0);
+  gzwrite(fp, buf, n);
+}
+
+static bool get_leb128(uint64_t *x) {
+  *x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = gzgetc(fp);
+    if (c < 0) return false;
+    *x |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+void replay_input(void *buf, size_t len) {
+  if (fp == NULL) return;
+  if (!replaying) {
+    put_leb128(g_nr_guest_inst - last_inst);
+    gzwrite(fp, buf, len);
+    last_inst = g_nr_guest_inst;
+    return;
+  }
+
+  uint64_t delta;
+  if (!get_leb128(&delta)) {
+    Log("The replay ends at instruction %" PRIu64 ", the inputs are taken from the host from now on", g_nr_guest_inst);
+    gzclose(fp);
+    fp = NULL;
+    replaying = false;
+    return;
+  }
+  uint64_t when = last_inst + delta;
+  Assert(when == g_nr_guest_inst, "The replay diverges: the input at instruction %" PRIu64
+      " is taken at instruction %" PRIu64, when, g_nr_guest_inst);
+  int ret = gzread(fp, buf, len);
+  Assert(ret == (int)len, "The record is truncated at instruction %" PRIu64, when);
+  last_inst = when;
+}
+
+// also called when NEMU aborts, so that the record up to there is complete
+void replay_close() {
+  if (fp == NULL) return;
+  gzclose(fp);
+  fp = NULL;
+}
+
+void init_replay(const char *record_file, const char *replay_file) {
+  Assert(record_file == NULL || replay_file == NULL, "Can not record and replay at the same time");
+  const char *file = (replay_file ? replay_file : record_file);
+  if (file == NULL) return;
+  replaying = (replay_file != NULL);
+  fp = gzopen(file, (replaying ? "rb" : "wb"));
+  Assert(fp, "Can not open '%s'", file);
+  if (replaying) {
+    char magic[8];
+    int ret = gzread(fp, magic, sizeof(magic));
+    Assert(ret == sizeof(magic) && memcmp(magic, REPLAY_MAGIC, sizeof(magic)) == 0,
+        "'%s' is not a record of the inputs", file);
+  } else {
+    gzwrite(fp, REPLAY_MAGIC, 8);
+  }
+  atexit(replay_close);
+  Log("%s the inputs from the host %s %s", (replaying ? "Replay" : "Record"), (replaying ? "from" : "to"), file);
+}
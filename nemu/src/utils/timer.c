@@ -43,3 +43,15 @@ uint64_t get_time() {
   uint64_t now = get_time_internal();
   return now - boot_time;
 }
+
+// the time observed by the guest (unit: us)
+uint64_t get_guest_time() {
+#ifdef CONFIG_TIMER_VIRTUAL
+  extern uint64_t g_nr_guest_inst;
+  return g_nr_guest_inst * CONFIG_TIMER_VIRTUAL_NS_PER_INST / 1000;
+#else
+  uint64_t us = get_time();
+  host_input(&us, sizeof(us));
+  return us;
+#endif
+}
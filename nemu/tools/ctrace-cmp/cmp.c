@@ -0,0 +1,226 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <ctrace-def.h>
+
+// Compare two commit traces written by --ctrace. The chunks are compared
+// in parallel, and the first divergence is reported with the records
+// before it.
+
+typedef struct {
+  const char *name;
+  const uint8_t *base;
+  size_t size;
+  const CTraceHeader *header;
+  const CTraceFooter *footer;
+  const CTraceIndex *index;
+} Trace;
+
+static Trace trace[2];
+static uint64_t nr_common = 0;   // number of records in both traces
+static uint64_t nr_chunk = 0;    // of the shorter trace
+static atomic_uint_fast64_t next_chunk = 0;
+static atomic_uint_fast64_t first_diff = UINT64_MAX;
+static int nr_context = 10;
+
+static void open_trace(Trace *t, const char *name) {
+  t->name = name;
+  int fd = open(name, O_RDONLY);
+  if (fd < 0) { perror(name); exit(1); }
+  struct stat st;
+  fstat(fd, &st);
+  t->size = st.st_size;
+  if (t->size < sizeof(CTraceHeader) + sizeof(CTraceFooter)) {
+    fprintf(stderr, "%s: too short to be a commit trace\n", name);
+    exit(1);
+  }
+  t->base = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(t->base != MAP_FAILED);
+  close(fd);
+
+  t->header = (const CTraceHeader *)t->base;
+  t->footer = (const CTraceFooter *)(t->base + t->size - sizeof(CTraceFooter));
+  if (memcmp(t->header->magic, CTRACE_MAGIC, 8) || memcmp(t->footer->magic, CTRACE_MAGIC, 8) ||
+      t->header->version != CTRACE_VERSION) {
+    fprintf(stderr, "%s: not a commit trace of version %d, or not closed properly\n", name, CTRACE_VERSION);
+    exit(1);
+  }
+  t->index = (const CTraceIndex *)(t->base + t->footer->index_offset);
+}
+
+// decode chunk `k` of `t` into `r`, return the number of records
+static uint32_t load_chunk(const Trace *t, uint64_t k, uint8_t *raw, CTraceRecord *r) {
+  const CTraceChunk *c = (const CTraceChunk *)(t->base + t->index[k].offset);
+  uLongf raw_size = c->raw_size;
+  int ret = uncompress(raw, &raw_size, (const uint8_t *)(c + 1), c->comp_size);
+  if (ret != Z_OK || raw_size != c->raw_size) {
+    fprintf(stderr, "%s: chunk %" PRIu64 " is corrupted\n", t->name, k);
+    exit(1);
+  }
+  CTraceState s = {};
+  const uint8_t *p = raw;
+  for (uint32_t i = 0; i < c->nr_inst; i ++) p = ctrace_decode(p, &s, &r[i]);
+  return c->nr_inst;
+}
+
+static bool record_equal(const CTraceRecord *a, const CTraceRecord *b) {
+  if (a->pc != b->pc || a->inst != b->inst || a->rd != b->rd || a->data != b->data ||
+      a->nr_write != b->nr_write) return false;
+  for (int i = 0; i < a->nr_write; i ++) {
+    if (a->write[i].addr != b->write[i].addr || a->write[i].len != b->write[i].len ||
+        a->write[i].data != b->write[i].data) return false;
+  }
+  return true;
+}
+
+static void update_first_diff(uint64_t idx) {
+  uint64_t old = atomic_load(&first_diff);
+  while (idx < old && !atomic_compare_exchange_weak(&first_diff, &old, idx));
+}
+
+static void *worker(void *arg) {
+  uint32_t chunk_insts = trace[0].header->chunk_insts;
+  uint8_t *raw = malloc((size_t)chunk_insts * CTRACE_MAX_RECORD);
+  CTraceRecord *r[2];
+  r[0] = malloc(sizeof(CTraceRecord) * chunk_insts);
+  r[1] = malloc(sizeof(CTraceRecord) * chunk_insts);
+  assert(raw && r[0] && r[1]);
+
+  uint64_t k;
+  while ((k = atomic_fetch_add(&next_chunk, 1)) < nr_chunk) {
+    uint64_t first = trace[0].index[k].first_idx;
+    if (first >= atomic_load(&first_diff)) break;
+    uint32_t n0 = load_chunk(&trace[0], k, raw, r[0]);
+    uint32_t n1 = load_chunk(&trace[1], k, raw, r[1]);
+    uint32_t n = (n0 < n1 ? n0 : n1);
+    for (uint32_t i = 0; i < n; i ++) {
+      if (!record_equal(&r[0][i], &r[1][i])) { update_first_diff(first + i); break; }
+    }
+  }
+
+  free(raw);
+  free(r[0]);
+  free(r[1]);
+  return NULL;
+}
+
+static void print_record(const char *prefix, uint64_t idx, const CTraceRecord *r) {
+  printf("%s %12" PRIu64 "  pc = 0x%08" PRIx64 "  inst = %08x", prefix, idx, r->pc, r->inst);
+  if (r->rd != 0) printf("  x%-2d = 0x%08" PRIx64, r->rd, r->data);
+  for (int i = 0; i < r->nr_write; i ++) {
+    printf("  M[0x%08" PRIx64 "](%d) = 0x%" PRIx64, r->write[i].addr, r->write[i].len, r->write[i].data);
+  }
+  printf("\n");
+}
+
+// decode records [idx - nr_context, idx] of both traces and print them
+static void report(uint64_t idx) {
+  uint32_t chunk_insts = trace[0].header->chunk_insts;
+  uint8_t *raw = malloc((size_t)chunk_insts * CTRACE_MAX_RECORD);
+  CTraceRecord *r = malloc(sizeof(CTraceRecord) * chunk_insts * 2);
+  assert(raw && r);
+
+  uint64_t from = (idx > (uint64_t)nr_context ? idx - nr_context : 0);
+  for (int t = 0; t < 2; t ++) {
+    printf("%s:\n", trace[t].name);
+    uint64_t k = from / chunk_insts;
+    uint64_t nr_chunk_t = trace[t].footer->nr_chunk;
+    // at most two chunks are needed
+    uint32_t n = 0;
+    for (uint64_t j = k; j <= idx / chunk_insts && j < nr_chunk_t; j ++) {
+      n += load_chunk(&trace[t], j, raw, r + n);
+    }
+    for (uint64_t i = from; i <= idx; i ++) {
+      uint64_t off = i - k * chunk_insts;
+      if (off >= n) { printf("%s %12" PRIu64 "  <end of trace>\n", (i == idx ? ">" : " "), i); break; }
+      print_record(i == idx ? ">" : " ", i, &r[off]);
+    }
+  }
+
+  free(raw);
+  free(r);
+}
+
+static uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char *argv[]) {
+  int nr_thread = sysconf(_SC_NPROCESSORS_ONLN);
+  int o;
+  while ((o = getopt(argc, argv, "j:c:")) != -1) {
+    switch (o) {
+      case 'j': nr_thread = atoi(optarg); break;
+      case 'c': nr_context = atoi(optarg); break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 2) {
+usage:
+    fprintf(stderr, "Usage: %s [-j THREADS] [-c CONTEXT] TRACE1 TRACE2\n", argv[0]);
+    return 1;
+  }
+  if (nr_thread < 1) nr_thread = 1;
+
+  open_trace(&trace[0], argv[optind]);
+  open_trace(&trace[1], argv[optind + 1]);
+  if (trace[0].header->chunk_insts != trace[1].header->chunk_insts) {
+    fprintf(stderr, "The traces use different chunk sizes (%u and %u)\n",
+        trace[0].header->chunk_insts, trace[1].header->chunk_insts);
+    return 1;
+  }
+  // the context is decoded from at most two chunks
+  uint32_t chunk_insts = trace[0].header->chunk_insts;
+  if (nr_context < 0) nr_context = 0;
+  if ((uint32_t)nr_context >= chunk_insts) nr_context = chunk_insts - 1;
+  uint64_t n0 = trace[0].footer->nr_inst, n1 = trace[1].footer->nr_inst;
+  nr_common = (n0 < n1 ? n0 : n1);
+  nr_chunk = (trace[0].footer->nr_chunk < trace[1].footer->nr_chunk ?
+      trace[0].footer->nr_chunk : trace[1].footer->nr_chunk);
+
+  uint64_t start = now_us();
+  pthread_t *threads = malloc(sizeof(pthread_t) * nr_thread);
+  for (int i = 0; i < nr_thread; i ++) pthread_create(&threads[i], NULL, worker, NULL);
+  for (int i = 0; i < nr_thread; i ++) pthread_join(threads[i], NULL);
+  uint64_t us = now_us() - start;
+
+  uint64_t diff = atomic_load(&first_diff);
+  if (diff == UINT64_MAX && n0 != n1) diff = nr_common;
+  printf("Compared %" PRIu64 " instructions with %d threads in %" PRIu64 ".%03" PRIu64 " s\n",
+      (diff == UINT64_MAX ? nr_common : diff), nr_thread, us / 1000000, us / 1000 % 1000);
+  if (diff == UINT64_MAX) {
+    printf("The traces are identical\n");
+    return 0;
+  }
+  printf("The traces diverge at instruction %" PRIu64 "\n", diff);
+  report(diff);
+  return 1;
+}
@@ -0,0 +1,153 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <difftest-def.h>
+
+// Measure the speed of a REF in the ways NEMU drives it:
+//   step  - difftest_exec(1) and difftest_regcpy() after every instruction
+//   batch - difftest_exec(n) and difftest_regcpy() every n instructions
+//   until - difftest_exec_until() to the loop head, if the REF provides it
+
+typedef uint32_t paddr_t;
+
+#if defined(CONFIG_ISA_x86)
+typedef uint32_t reg_t;
+#define PC_IDX 8
+// inc %eax; jmp .-1
+static const uint8_t loop[] = { 0x40, 0xeb, 0xfd };
+#define LOOP_LEN 2
+#elif defined(CONFIG_ISA_riscv)
+typedef RISCV_GPR_TYPE reg_t;
+#define PC_IDX RISCV_GPR_NUM
+// addi a0, a0, 1; j .-4
+static const uint32_t loop[] = { 0x00150513, 0xffdff06f };
+#define LOOP_LEN 2
+#else
+#error Unsupported ISA
+#endif
+
+static void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction);
+static void (*ref_difftest_regcpy)(void *dut, bool direction);
+static void (*ref_difftest_exec)(uint64_t n);
+static void (*ref_difftest_exec_until)(uint64_t pc, uint64_t hits);
+
+static uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void report(const char *name, uint64_t n, uint64_t us) {
+  if (us == 0) us = 1;
+  printf("%-6s %10lu instructions in %8lu us, %10lu inst/s\n",
+      name, (unsigned long)n, (unsigned long)us, (unsigned long)(n * 1000000 / us));
+}
+
+static void *load(void *handle, const char *name, bool required) {
+  void *p = dlsym(handle, name);
+  if (p == NULL && required) {
+    fprintf(stderr, "%s is not found in the REF\n", name);
+    exit(1);
+  }
+  return p;
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t n = 100000, batch = 1024;
+  int port = 1234;
+  const char *img = NULL;
+  int o;
+  while ((o = getopt(argc, argv, "n:b:p:i:")) != -1) {
+    switch (o) {
+      case 'n': n = strtoull(optarg, NULL, 0); break;
+      case 'b': batch = strtoull(optarg, NULL, 0); break;
+      case 'p': port = atoi(optarg); break;
+      case 'i': img = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n inst] [-b batch] [-p port] [-i image] ref-so\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-n inst] [-b batch] [-p port] [-i image] ref-so\n", argv[0]);
+    return 1;
+  }
+
+  void *handle = dlopen(argv[optind], RTLD_LAZY);
+  if (handle == NULL) { fprintf(stderr, "%s\n", dlerror()); return 1; }
+  ref_difftest_memcpy = load(handle, "difftest_memcpy", true);
+  ref_difftest_regcpy = load(handle, "difftest_regcpy", true);
+  ref_difftest_exec = load(handle, "difftest_exec", true);
+  ref_difftest_exec_until = load(handle, "difftest_exec_until", false);
+  void (*ref_difftest_init)(int) = load(handle, "difftest_init", true);
+  ref_difftest_init(port);
+
+  // the image should run for at least `n` instructions
+  paddr_t entry = CONFIG_MBASE + CONFIG_PC_RESET_OFFSET;
+  if (img != NULL) {
+    FILE *fp = fopen(img, "rb");
+    if (fp == NULL) { perror(img); return 1; }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    void *buf = malloc(size);
+    assert(buf);
+    int ret = fread(buf, size, 1, fp);
+    assert(ret == 1);
+    fclose(fp);
+    ref_difftest_memcpy(entry, buf, size, DIFFTEST_TO_REF);
+    free(buf);
+  } else {
+    ref_difftest_memcpy(entry, (void *)loop, sizeof(loop), DIFFTEST_TO_REF);
+  }
+
+  reg_t regs[DIFFTEST_REG_SIZE / sizeof(reg_t)];
+  ref_difftest_regcpy(regs, DIFFTEST_TO_DUT);
+  regs[PC_IDX] = entry;
+  ref_difftest_regcpy(regs, DIFFTEST_TO_REF);
+
+  uint64_t t0 = now_us();
+  for (uint64_t i = 0; i < n; i ++) {
+    ref_difftest_exec(1);
+    ref_difftest_regcpy(regs, DIFFTEST_TO_DUT);
+  }
+  report("step", n, now_us() - t0);
+
+  t0 = now_us();
+  for (uint64_t i = 0; i < n; i += batch) {
+    ref_difftest_exec(batch);
+    ref_difftest_regcpy(regs, DIFFTEST_TO_DUT);
+  }
+  report("batch", n, now_us() - t0);
+
+  // the loop head is reached once every LOOP_LEN instructions
+  if (ref_difftest_exec_until != NULL && img == NULL) {
+    t0 = now_us();
+    for (uint64_t i = 0; i < n; i += batch) {
+      ref_difftest_exec_until(entry, batch / LOOP_LEN);
+      ref_difftest_regcpy(regs, DIFFTEST_TO_DUT);
+    }
+    report("until", n, now_us() - t0);
+  }
+  return 0;
+}
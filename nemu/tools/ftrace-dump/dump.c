@@ -0,0 +1,159 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ftrace-def.h>
+
+// Print a function trace written by --ftrace, either as the call flow or
+// as the profile of the functions.
+
+static const FTraceHeader *header = NULL;
+static const FTraceRecord *record = NULL;
+static const FTraceFunc *func = NULL;
+static const char *names = NULL;
+static uint64_t nr_record = 0, nr_func = 0;
+static int addr_width = 8;
+
+static void open_trace(const char *name) {
+  int fd = open(name, O_RDONLY);
+  if (fd < 0) { perror(name); exit(1); }
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+  if (size < sizeof(FTraceHeader) + sizeof(FTraceFooter)) {
+    fprintf(stderr, "%s: too short to be a function trace\n", name);
+    exit(1);
+  }
+  const uint8_t *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(base != MAP_FAILED);
+  close(fd);
+
+  header = (const FTraceHeader *)base;
+  const FTraceFooter *footer = (const FTraceFooter *)(base + size - sizeof(FTraceFooter));
+  if (memcmp(header->magic, FTRACE_MAGIC, 8) || memcmp(footer->magic, FTRACE_MAGIC, 8) ||
+      header->version != FTRACE_VERSION) {
+    fprintf(stderr, "%s: not a function trace of version %d, or not closed properly\n", name, FTRACE_VERSION);
+    exit(1);
+  }
+  record = (const FTraceRecord *)(header + 1);
+  nr_record = footer->nr_record;
+  func = (const FTraceFunc *)(base + footer->func_offset);
+  nr_func = footer->nr_func;
+  names = (const char *)(func + nr_func);
+  addr_width = header->word_size * 2;
+}
+
+static const FTraceFunc *find_func(uint64_t addr) {
+  int64_t l = 0, r = nr_func - 1;
+  while (l <= r) {
+    int64_t m = (l + r) / 2;
+    if (func[m].addr == addr) return &func[m];
+    if (func[m].addr < addr) l = m + 1;
+    else r = m - 1;
+  }
+  return NULL;
+}
+
+static void print_func(uint64_t addr) {
+  const FTraceFunc *f = find_func(addr);
+  if (f && f->name != FTRACE_NO_NAME) printf("%s", names + f->name);
+  else printf("0x%0*" PRIx64, addr_width, addr);
+}
+
+static void print_flow() {
+  uint64_t *stack = malloc(sizeof(uint64_t) * (nr_record + 1));
+  assert(stack);
+  int64_t sp = 0;
+  for (uint64_t i = 0; i < nr_record; i ++) {
+    const FTraceRecord *r = &record[i];
+    bool ret = (r->time & FTRACE_RET) != 0;
+    if (ret && sp > 0) sp --;
+    printf("%12" PRIu64 "  0x%0*" PRIx64 ": %*s", (uint64_t)(r->time & ~FTRACE_RET), addr_width, r->pc, (int)(sp * 2), "");
+    if (ret) {
+      printf("ret  ");
+      if (sp >= 0 && stack[sp] != 0) print_func(stack[sp]);
+      printf("\n");
+    } else {
+      printf("call ");
+      print_func(r->target);
+      printf(" [0x%0*" PRIx64 "]\n", addr_width, r->target);
+      stack[sp ++] = r->target;
+    }
+    stack[sp] = 0;
+  }
+  free(stack);
+}
+
+static int by_inclusive(const void *a, const void *b) {
+  uint64_t x = (*(const FTraceFunc **)a)->inclusive, y = (*(const FTraceFunc **)b)->inclusive;
+  return (x < y) - (x > y);
+}
+
+static void print_profile(uint64_t n) {
+  const FTraceFunc **f = malloc(sizeof(FTraceFunc *) * nr_func);
+  assert(f);
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < nr_func; i ++) {
+    f[i] = &func[i];
+    total += func[i].exclusive;
+  }
+  qsort(f, nr_func, sizeof(f[0]), by_inclusive);
+  if (total == 0) total = 1;
+
+  printf("%7s %14s %7s %14s %10s  %s\n", "incl%", "inclusive", "excl%", "exclusive", "calls", "function");
+  for (uint64_t i = 0; i < nr_func && (n == 0 || i < n); i ++) {
+    printf("%6.2f%% %14" PRIu64 " %6.2f%% %14" PRIu64 " %10" PRIu64 "  ",
+        100.0 * f[i]->inclusive / total, f[i]->inclusive,
+        100.0 * f[i]->exclusive / total, f[i]->exclusive, f[i]->nr_call);
+    print_func(f[i]->addr);
+    printf("\n");
+  }
+  free(f);
+}
+
+int main(int argc, char *argv[]) {
+  bool profile = false;
+  uint64_t n = 30;
+  int o;
+  while ((o = getopt(argc, argv, "pn:")) != -1) {
+    switch (o) {
+      case 'p': profile = true; break;
+      case 'n': n = strtoull(optarg, NULL, 0); break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 1) {
+usage:
+    fprintf(stderr, "Usage: %s [-p [-n NR_FUNC]] TRACE\n", argv[0]);
+    fprintf(stderr, "  print the call flow, or with -p the NR_FUNC (default 30, 0 for all)\n"
+                    "  functions with the most instructions\n");
+    return 1;
+  }
+
+  open_trace(argv[optind]);
+  if (profile) print_profile(n);
+  else print_flow();
+  return 0;
+}
@@ -0,0 +1,165 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Receive the memory exported by NEMU, map it read-only and print the
+// layout, dump a range of guest memory, or save the frame buffer.
+
+#define MAX_FD 4
+#define MAX_REGION 64
+
+typedef struct {
+  char name[32];
+  int fd;
+  uint64_t addr, size, offset;
+} Region;
+
+static int nr_fd = 0;
+static uint8_t *base[MAX_FD];
+static Region region[MAX_REGION];
+static int nr_region = 0;
+
+static void receive(const char *path) {
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) { perror("socket"); exit(1); }
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) { perror(path); exit(1); }
+
+  char buf[4096];
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * MAX_FD)];
+    struct cmsghdr align;
+  } ctl;
+  struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) - 1 };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf) };
+  ssize_t ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (ret <= 0) { fprintf(stderr, "%s: no reply\n", path); exit(1); }
+  int len = ret;
+  while (len < (int)sizeof(buf) - 1 && (ret = read(sock, buf + len, sizeof(buf) - 1 - len)) > 0) len += ret;
+  buf[len] = '\0';
+  close(sock);
+
+  int fd[MAX_FD];
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+      nr_fd = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(fd, CMSG_DATA(c), sizeof(int) * nr_fd);
+    }
+  }
+  for (int i = 0; i < nr_fd; i ++) {
+    struct stat st;
+    fstat(fd[i], &st);
+    base[i] = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd[i], 0);
+    if (base[i] == MAP_FAILED) { perror("mmap"); exit(1); }
+    close(fd[i]);
+  }
+
+  for (char *line = strtok(buf, "\n"); line != NULL && nr_region < MAX_REGION; line = strtok(NULL, "\n")) {
+    Region *r = &region[nr_region];
+    if (sscanf(line, "%31s %d %" SCNx64 " %" SCNx64 " %" SCNx64, r->name, &r->fd, &r->addr, &r->size, &r->offset) == 5 &&
+        r->fd < nr_fd) nr_region ++;
+  }
+}
+
+static const Region *find_region(const char *name) {
+  for (int i = 0; i < nr_region; i ++) {
+    if (strcmp(region[i].name, name) == 0) return &region[i];
+  }
+  return NULL;
+}
+
+static const uint8_t *guest_to_host(uint64_t addr, uint64_t len) {
+  for (int i = 0; i < nr_region; i ++) {
+    const Region *r = &region[i];
+    if (addr >= r->addr && addr + len <= r->addr + r->size) return base[r->fd] + r->offset + (addr - r->addr);
+  }
+  return NULL;
+}
+
+static void hexdump(uint64_t addr, uint64_t len) {
+  const uint8_t *p = guest_to_host(addr, len);
+  if (p == NULL) { fprintf(stderr, "[0x%" PRIx64 ", 0x%" PRIx64 ") is not exported\n", addr, addr + len); exit(1); }
+  for (uint64_t i = 0; i < len; i += 16) {
+    printf("0x%08" PRIx64 ":", addr + i);
+    for (uint64_t j = i; j < i + 16 && j < len; j ++) printf(" %02x", p[j]);
+    printf("\n");
+  }
+}
+
+// save the frame buffer as a PPM image, the size is read from vgactl
+static void save_screen(const char *file) {
+  const Region *ctl = find_region("vgactl"), *vmem = find_region("vmem");
+  if (ctl == NULL || vmem == NULL) { fprintf(stderr, "The frame buffer is not exported\n"); exit(1); }
+  uint32_t wh = *(const uint32_t *)(base[ctl->fd] + ctl->offset);
+  int w = wh >> 16, h = wh & 0xffff;
+  const uint32_t *fb = (const uint32_t *)(base[vmem->fd] + vmem->offset);
+  if ((uint64_t)w * h * 4 > vmem->size) { fprintf(stderr, "Bad screen size %dx%d\n", w, h); exit(1); }
+
+  FILE *fp = fopen(file, "wb");
+  if (fp == NULL) { perror(file); exit(1); }
+  fprintf(fp, "P6\n%d %d\n255\n", w, h);
+  for (int i = 0; i < w * h; i ++) {
+    uint8_t rgb[3] = { fb[i] >> 16, fb[i] >> 8, fb[i] };
+    fwrite(rgb, 3, 1, fp);
+  }
+  fclose(fp);
+  printf("Saved the %dx%d screen to %s\n", w, h, file);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dump = NULL, *screen = NULL;
+  int o;
+  while ((o = getopt(argc, argv, "x:s:")) != -1) {
+    switch (o) {
+      case 'x': dump = optarg; break;
+      case 's': screen = optarg; break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 1) {
+usage:
+    fprintf(stderr, "Usage: %s [-x ADDR:LEN] [-s SCREEN.ppm] SOCKET\n", argv[0]);
+    return 1;
+  }
+
+  receive(argv[optind]);
+  if (dump != NULL) {
+    uint64_t addr, len;
+    if (sscanf(dump, "%" SCNx64 ":%" SCNi64, &addr, &len) != 2) goto usage;
+    hexdump(addr, len);
+  }
+  if (screen != NULL) save_screen(screen);
+  if (dump == NULL && screen == NULL) {
+    printf("%-12s %3s %18s %12s %12s\n", "name", "fd", "addr", "size", "offset");
+    for (int i = 0; i < nr_region; i ++) {
+      const Region *r = &region[i];
+      printf("%-12s %3d 0x%016" PRIx64 " 0x%010" PRIx64 " 0x%010" PRIx64 "\n", r->name, r->fd, r->addr, r->size, r->offset);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Poll the metrics socket of NEMU and print a line of rates per interval,
+// until NEMU exits.
+
+#define MAX_KEY 32
+
+typedef struct {
+  int n;
+  char key[MAX_KEY][64];
+  char val[MAX_KEY][64];
+} Reply;
+
+static const char *path = NULL;
+
+// return 0 if NEMU is gone
+static int query(Reply *r) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) { perror("socket"); exit(1); }
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); return 0; }
+  if (write(fd, "get\n", 4) != 4) { close(fd); return 0; }
+
+  char buf[4096];
+  int len = 0;
+  ssize_t ret;
+  while (len < (int)sizeof(buf) - 1 && (ret = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) len += ret;
+  close(fd);
+  buf[len] = '\0';
+
+  r->n = 0;
+  for (char *line = strtok(buf, "\n"); line != NULL && r->n < MAX_KEY; line = strtok(NULL, "\n")) {
+    if (sscanf(line, "%63s %63s", r->key[r->n], r->val[r->n]) == 2) r->n ++;
+  }
+  return 1;
+}
+
+static const char *lookup(const Reply *r, const char *key) {
+  for (int i = 0; i < r->n; i ++) {
+    if (strcmp(r->key[i], key) == 0) return r->val[i];
+  }
+  return NULL;
+}
+
+static const char *lookup_str(const Reply *r, const char *key) {
+  const char *v = lookup(r, key);
+  return (v ? v : "-");
+}
+
+static uint64_t lookup_u64(const Reply *r, const char *key) {
+  const char *v = lookup(r, key);
+  return (v ? strtoull(v, NULL, 0) : 0);
+}
+
+int main(int argc, char *argv[]) {
+  double interval = 1;
+  int o;
+  while ((o = getopt(argc, argv, "i:")) != -1) {
+    switch (o) {
+      case 'i': interval = atof(optarg); break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 1 || interval <= 0) {
+usage:
+    fprintf(stderr, "Usage: %s [-i SECONDS] SOCKET\n", argv[0]);
+    return 1;
+  }
+  path = argv[optind];
+
+  Reply last, cur;
+  if (!query(&last)) { perror(path); return 1; }
+  struct timespec ts = { .tv_sec = (time_t)interval, .tv_nsec = (long)((interval - (time_t)interval) * 1e9) };
+  printf("%16s %10s %10s %12s %12s  %s\n", "instructions", "MIPS", "state", "pc", "difftest_lag", "events/s");
+  while (1) {
+    nanosleep(&ts, NULL);
+    if (!query(&cur)) break;
+    uint64_t us = lookup_u64(&cur, "host_time_us") - lookup_u64(&last, "host_time_us");
+    uint64_t inst = lookup_u64(&cur, "instructions") - lookup_u64(&last, "instructions");
+    printf("%16" PRIu64 " %10.3f %10s %12s %12s ", lookup_u64(&cur, "instructions"),
+        (us ? (double)inst / us : 0), lookup_str(&cur, "state"), lookup_str(&cur, "pc"),
+        lookup_str(&cur, "difftest_lag"));
+    for (int i = 0; i < cur.n; i ++) {
+      if (strncmp(cur.key[i], "event.", 6) != 0) continue;
+      uint64_t d = strtoull(cur.val[i], NULL, 0) - lookup_u64(&last, cur.key[i]);
+      printf(" %s=%.0f", cur.key[i] + 6, (us ? d * 1e6 / us : 0));
+    }
+    printf("\n");
+    fflush(stdout);
+    last = cur;
+  }
+  printf("NEMU has exited\n");
+  return 0;
+}
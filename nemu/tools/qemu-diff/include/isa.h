@@ -33,6 +33,13 @@
 #error Unsupport ISA
 #endif
 
+// length of the breakpoint instruction for the 'Z0' packet
+#if defined(CONFIG_ISA_x86)
+#define ISA_BP_KIND 1
+#else
+#define ISA_BP_KIND 4
+#endif
+
 union isa_gdb_regs {
   struct {
 #if defined(CONFIG_ISA_mips32)
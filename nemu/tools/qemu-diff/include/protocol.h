@@ -34,4 +34,8 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size);
 
 uint8_t *gdb_recv(struct gdb_conn *conn, size_t *size);
 
+void gdb_queue(struct gdb_conn *conn, const uint8_t *command, size_t size);
+
+size_t gdb_escape_binary(uint8_t *out, const uint8_t *in, size_t size);
+
 const char * gdb_start_noack(struct gdb_conn *conn);
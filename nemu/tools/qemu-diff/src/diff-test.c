@@ -20,24 +20,30 @@
 
 bool gdb_connect_qemu(int);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
+bool gdb_memcpy_from_qemu(uint32_t, void *, int);
 bool gdb_getregs(union isa_gdb_regs *);
 bool gdb_setregs(union isa_gdb_regs *);
 bool gdb_si();
+bool gdb_run_until(uint64_t pc, uint64_t hits);
 void gdb_exit();
 
 void init_isa();
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  assert(direction == DIFFTEST_TO_REF);
-  if (direction == DIFFTEST_TO_REF) {
-    bool ok = gdb_memcpy_to_qemu(addr, buf, n);
-    assert(ok == 1);
-  }
+  bool ok = (direction == DIFFTEST_TO_REF ? gdb_memcpy_to_qemu(addr, buf, n) :
+      gdb_memcpy_from_qemu(addr, buf, n));
+  assert(ok == 1);
 }
 
+// registers of QEMU, fetched at most once after each execution
+static union isa_gdb_regs qemu_r;
+static bool qemu_r_valid = false;
+
 __EXPORT void difftest_regcpy(void *dut, bool direction) {
-  union isa_gdb_regs qemu_r;
-  gdb_getregs(&qemu_r);
+  if (!qemu_r_valid) {
+    gdb_getregs(&qemu_r);
+    qemu_r_valid = true;
+  }
   if (direction == DIFFTEST_TO_REF) {
     memcpy(&qemu_r, dut, DIFFTEST_REG_SIZE);
     gdb_setregs(&qemu_r);
@@ -47,9 +53,19 @@ __EXPORT void difftest_regcpy(void *dut, bool direction) {
 }
 
 __EXPORT void difftest_exec(uint64_t n) {
+  qemu_r_valid = false;
   while (n --) gdb_si();
 }
 
+// Extension: run with a breakpoint until `pc` has been reached `hits`
+// times, each after at least one instruction, instead of stepping one
+// instruction per round trip.
+__EXPORT void difftest_exec_until(uint64_t pc, uint64_t hits) {
+  qemu_r_valid = false;
+  bool ok = gdb_run_until(pc, hits);
+  assert(ok);
+}
+
 __EXPORT void difftest_init(int port) {
   char buf[32];
   sprintf(buf, "tcp::%d", port);
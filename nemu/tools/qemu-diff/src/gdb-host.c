@@ -14,8 +14,16 @@
 ***************************************************************************************/
 
 #include "common.h"
+#include <inttypes.h>
 
 static struct gdb_conn *conn;
+static bool has_binary_write = true;
+
+// Without ACKs, commands which do not resume the guest are queued and
+// sent together with the next request, saving one round trip each.
+static bool noack = false;
+static int nr_queued = 0;
+static bool queued_ok = true;
 
 bool gdb_connect_qemu(int port) {
   // connect to gdbserver on localhost port 1234
@@ -23,10 +31,63 @@ bool gdb_connect_qemu(int port) {
     usleep(1);
   }
 
+  noack = (gdb_start_noack(conn)[0] != '\0');
   return true;
 }
 
+// Send `cmd` and return its reply, after receiving the replies of the
+// queued commands. The reply should be freed by the caller.
+static uint8_t *gdb_request(const void *cmd, size_t len, size_t *size) {
+  gdb_send(conn, cmd, len);
+  for (; nr_queued > 0; nr_queued --) {
+    size_t n;
+    uint8_t *reply = gdb_recv(conn, &n);
+    queued_ok &= !strcmp((const char*)reply, "OK");
+    free(reply);
+  }
+  assert(queued_ok);
+  return gdb_recv(conn, size);
+}
+
+// send `cmd` and expect "OK"
+static bool gdb_command(const char *cmd) {
+  size_t size;
+  uint8_t *reply = gdb_request(cmd, strlen(cmd), &size);
+  bool ok = !strcmp((const char*)reply, "OK");
+  free(reply);
+  return ok;
+}
+
+// the reply, which should be "OK", is checked by the next request
+static void gdb_command_queued(const char *cmd) {
+  if (!noack) { queued_ok &= gdb_command(cmd); return; }
+  gdb_queue(conn, (const uint8_t *)cmd, strlen(cmd));
+  nr_queued ++;
+}
+
+// binary write with 'X'
+static bool gdb_memcpy_to_qemu_binary(uint32_t dest, void *src, int len) {
+  uint8_t *buf = malloc(len * 2 + 128);
+  assert(buf != NULL);
+  int p = sprintf((char *)buf, "X%x,%x:", dest, len);
+  p += gdb_escape_binary(buf + p, src, len);
+
+  size_t size;
+  uint8_t *reply = gdb_request(buf, p, &size);
+  free(buf);
+  if (size == 0) has_binary_write = false; // not supported
+  bool ok = !strcmp((const char*)reply, "OK");
+  free(reply);
+
+  return ok;
+}
+
 static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
+  if (has_binary_write) {
+    bool ok = gdb_memcpy_to_qemu_binary(dest, src, len);
+    if (has_binary_write) return ok;
+  }
+
   char *buf = malloc(len * 2 + 128);
   assert(buf != NULL);
   int p = sprintf(buf, "M0x%x,%x:", dest, len);
@@ -35,14 +96,9 @@ static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
     p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  bool ok = gdb_command(buf);
   free(buf);
 
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
-
   return ok;
 }
 
@@ -59,10 +115,31 @@ bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
   return ok;
 }
 
+// read with 'm', the reply is hex encoded
+bool gdb_memcpy_from_qemu(uint32_t src, void *dest, int len) {
+  const int mtu = 1500;
+  char cmd[32];
+  while (len > 0) {
+    int n = (len > mtu ? mtu : len);
+    sprintf(cmd, "m%x,%x", src, n);
+    size_t size;
+    uint8_t *reply = gdb_request(cmd, strlen(cmd), &size);
+    bool ok = (size == (size_t)2 * n);
+    for (int i = 0; ok && i < n; i ++) {
+      ((uint8_t *)dest)[i] = gdb_decode_hex(reply[2 * i], reply[2 * i + 1]);
+    }
+    free(reply);
+    if (!ok) return false;
+    src += n;
+    dest += n;
+    len -= n;
+  }
+  return true;
+}
+
 bool gdb_getregs(union isa_gdb_regs *r) {
-  gdb_send(conn, (const uint8_t *)"g", 1);
   size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
+  uint8_t *reply = gdb_request("g", 1, &size);
 
   int i;
   uint8_t *p = reply;
@@ -93,26 +170,46 @@ bool gdb_setregs(union isa_gdb_regs *r) {
     p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  bool ok = gdb_command(buf);
   free(buf);
 
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
-
   return ok;
 }
 
+// a stop reply for SIGTRAP
+static bool is_trap(const uint8_t *reply) {
+  return (reply[0] == 'T' || reply[0] == 'S') && gdb_decode_hex(reply[1], reply[2]) == 5;
+}
+
 bool gdb_si() {
   char buf[] = "vCont;s:1";
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
   size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
+  uint8_t *reply = gdb_request(buf, strlen(buf), &size);
   free(reply);
   return true;
 }
 
+// Run until `pc` has been reached `hits` times. QEMU reports a breakpoint
+// at the current pc without moving, so every time the guest first steps
+// off it. Setting and removing the breakpoint take no extra round trip.
+bool gdb_run_until(uint64_t pc, uint64_t hits) {
+  char buf[64];
+  sprintf(buf, "Z0,%" PRIx64 ",%x", pc, ISA_BP_KIND);
+  gdb_command_queued(buf);
+  bool ok = true;
+  for (; hits > 0 && ok; hits --) {
+    gdb_si();
+    char cont[] = "vCont;c:1";
+    size_t size;
+    uint8_t *reply = gdb_request(cont, strlen(cont), &size);
+    ok = is_trap(reply);
+    free(reply);
+  }
+  sprintf(buf, "z0,%" PRIx64 ",%x", pc, ISA_BP_KIND);
+  gdb_command_queued(buf);
+  return ok;
+}
+
 void gdb_exit() {
   gdb_end(conn);
 }
@@ -135,7 +135,7 @@ void gdb_end(struct gdb_conn *conn) {
   free(conn);
 }
 
-static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+static void send_packet(FILE *out, const uint8_t *command, size_t size, bool flush) {
   // compute the checksum -- simple mod256 addition
   uint8_t sum = 0;
   size_t i;
@@ -149,7 +149,8 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
   fputc('$', out); // packet start
   fwrite(command, 1, size, out); // payload
   fprintf(out, "#%02X", sum); // packet end, checksum
-  fflush(out);
+  if (flush)
+    fflush(out);
 
   if (ferror(out))
     err(1, "send");
@@ -160,7 +161,7 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
 void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   bool acked = false;
   do {
-    send_packet(conn->out, command, size);
+    send_packet(conn->out, command, size, true);
 
     if (!conn->ack)
       break;
@@ -170,6 +171,28 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   } while (!acked);
 }
 
+// Queue a packet without waiting for the ACK. Only valid in no-ack mode;
+// the packets are sent with the next gdb_send().
+void gdb_queue(struct gdb_conn *conn, const uint8_t *command, size_t size) {
+  assert(!conn->ack);
+  send_packet(conn->out, command, size, false);
+}
+
+// Escape the binary data for 'X' packets, return the size of the output.
+// `out` should have room for 2 * size bytes.
+size_t gdb_escape_binary(uint8_t *out, const uint8_t *in, size_t size) {
+  size_t n = 0;
+  for (size_t i = 0; i < size; i ++) {
+    uint8_t c = in[i];
+    if (c == '$' || c == '#' || c == '}' || c == '*') {
+      out[n ++] = '}';
+      c ^= 0x20;
+    }
+    out[n ++] = c;
+  }
+  return n;
+}
+
 static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
   size_t i = 0;
   size_t size = 4096;
@@ -17,11 +17,13 @@
 #include "sim.h"
 #include "../../include/common.h"
 #include <difftest-def.h>
+#include <memory/hash.h>
 
 #define NR_GPR MUXDEF(CONFIG_RVE, 16, 32)
 
 static std::vector<std::pair<reg_t, abstract_device_t*>> difftest_plugin_devices;
 static std::vector<std::string> difftest_htif_args;
+static_assert(DIFFTEST_HASH_PAGE == PGSIZE, "a hashed page should be a page of mem_t");
 static std::vector<std::pair<reg_t, mem_t*>> difftest_mem(
     1, std::make_pair(reg_t(DRAM_BASE), new mem_t(CONFIG_MSIZE)));
 static debug_module_config_t difftest_dm_config = {
@@ -70,7 +72,80 @@ void sim_t::diff_set_regs(void* diff_context) {
   state->pc = ctx->pc;
 }
 
+// Copy with the backing store of DRAM page by page, instead of byte by
+// byte through the MMU. The instructions decoded and cached by the MMU
+// may be stale after that.
+static bool dram_memcpy(reg_t addr, uint8_t *buf, size_t n, bool to_ref) {
+  mem_t *mem = difftest_mem[0].second;
+  reg_t base = difftest_mem[0].first;
+  if (addr < base || addr - base > mem->size() || n > mem->size() - (addr - base)) return false;
+  addr -= base;
+  while (n > 0) {
+    size_t len = std::min(n, (size_t)(PGSIZE - addr % PGSIZE));
+    char *page = mem->contents(addr);
+    if (to_ref) memcpy(page, buf, len);
+    else memcpy(buf, page, len);
+    addr += len;
+    buf += len;
+    n -= len;
+  }
+  if (to_ref) p->get_mmu()->flush_icache();
+  return true;
+}
+
+// the GPR written by `inst`, the same as isa_inst_rd() of NEMU
+static int inst_rd(uint32_t inst) {
+  int rd = (inst >> 7) & 0x1f;
+  switch (inst & 0x7f) {
+    case 0x37: case 0x17: case 0x6f: case 0x67: // lui, auipc, jal, jalr
+    case 0x03: case 0x13: case 0x33: case 0x2f: // load, op-imm, op, amo
+    case 0x1b: case 0x3b: return rd;            // op-imm-32, op-32
+    case 0x73: if (((inst >> 12) & 7) != 0) return rd; // csr*, not ecall, mret, ...
+  }
+  return 0;
+}
+
+// Step one instruction and record what it writes, in the way NEMU records
+// its own instructions with isa_difftest_commit() and the write log. The
+// instruction is decoded here, so the commit log of Spike is not needed.
+static void diff_step_commit(diff_commit_t *c) {
+  mmu_t *mmu = p->get_mmu();
+  memset(c, 0, sizeof(*c));
+  c->pc = state->pc;
+  uint32_t inst = 0;
+  try {
+    inst = mmu->load<uint32_t>(c->pc);
+  } catch (trap_t &t) {
+    // the fetch faults in the step too
+  }
+  reg_t src1 = state->XPR[(inst >> 15) & 0x1f], src2 = state->XPR[(inst >> 20) & 0x1f];
+  s->diff_step(1);
+
+  int rd = inst_rd(inst);
+  c->rd = rd;
+  c->data = (rd != 0 ? (word_t)state->XPR[rd] : 0);
+  // stores and AMOs do not jump, anything else is a trap before the write
+  if (state->pc != c->pc + 4) return;
+  int len = 1 << ((inst >> 12) & 7);
+  switch (inst & 0x7f) {
+    case 0x23: // store
+      c->waddr = (word_t)(src1 + (((int32_t)inst >> 20 & ~0x1f) | ((inst >> 7) & 0x1f)));
+      c->wdata = src2;
+      break;
+    case 0x2f: // amo
+      if ((inst >> 27) == 0x2) return; // lr
+      if ((inst >> 27) == 0x3 && rd != 0 && state->XPR[rd] != 0) return; // sc fails
+      c->waddr = (word_t)src1;
+      if (!dram_memcpy(c->waddr, (uint8_t *)&c->wdata, len, false)) return;
+      break;
+    default: return;
+  }
+  c->wlen = len;
+  c->wdata &= ~0ull >> (64 - 8 * len);
+}
+
 void sim_t::diff_memcpy(reg_t dest, void* src, size_t n) {
+  if (dram_memcpy(dest, (uint8_t*)src, n, true)) return;
   mmu_t* mmu = p->get_mmu();
   for (size_t i = 0; i < n; i++) {
     mmu->store<uint8_t>(dest+i, *((uint8_t*)src+i));
@@ -83,7 +158,8 @@ __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction)
   if (direction == DIFFTEST_TO_REF) {
     s->diff_memcpy(addr, buf, n);
   } else {
-    assert(0);
+    bool ok = dram_memcpy(addr, (uint8_t*)buf, n, false);
+    assert(ok);
   }
 }
 
@@ -99,6 +175,24 @@ __EXPORT void difftest_exec(uint64_t n) {
   s->diff_step(n);
 }
 
+// Hash the `nr_page` pages from `addr` into `hash`, with mem_hash().
+__EXPORT void difftest_memhash(paddr_t addr, size_t nr_page, uint64_t *hash) {
+  mem_t *mem = difftest_mem[0].second;
+  reg_t base = difftest_mem[0].first;
+  for (size_t i = 0; i < nr_page; i++) {
+    reg_t off = addr + i * DIFFTEST_HASH_PAGE - base;
+    assert(addr >= base && off + DIFFTEST_HASH_PAGE <= mem->size());
+    hash[i] = mem_hash(mem->contents(off), DIFFTEST_HASH_PAGE);
+  }
+}
+
+// Run `n` instructions and report what each of them writes.
+__EXPORT void difftest_exec_commit(uint64_t n, diff_commit_t *log) {
+  for (uint64_t i = 0; i < n; i++) {
+    diff_step_commit(&log[i]);
+  }
+}
+
 __EXPORT void difftest_init(int port) {
   difftest_htif_args.push_back("");
   const char *isa = "RV" MUXDEF(CONFIG_RV64, "64", "32") MUXDEF(CONFIG_RVE, "E", "I") "MAFDC";